@@ -0,0 +1,101 @@
+#pragma once
+
+#ifndef ASSET_LOADER_HPP
+#define ASSET_LOADER_HPP
+
+#include <SFML/Graphics/Image.hpp>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "job_system.hpp"
+
+/*!
+Decodes images on the job system and hands them over on the render thread,
+where they can be uploaded to textures. Until then the textures show a placeholder.
+*/
+class AssetLoader {
+private:
+    struct Request {
+        std::string path;
+        std::function<void(const sf::Image &)> on_decoded;
+        sf::Image image;
+        bool is_loaded = false;  // written by the decoding job, read after it is done
+        JobSystem::Handle decoding;
+    };
+
+    std::vector<std::shared_ptr<Request>> pending;
+    std::vector<std::string> failed;
+
+public:
+    /*!
+    Returns a small image to show while the real one is being decoded.
+    */
+    static const sf::Image &placeholder() {
+        static const sf::Image image = [] {
+            sf::Image result;
+            result.create(1, 1, sf::Color(127, 127, 127, 127));
+            return result;
+        }();
+        return image;
+    }
+
+    /*!
+    Starts decoding the image at `path`.
+    `on_decoded` will be called from `upload_finished` once the image is ready.
+    */
+    void request(
+        JobSystem &jobs, const std::string &path, std::function<void(const sf::Image &)> on_decoded
+    ) {
+        auto req = std::make_shared<Request>();
+        req->path = path;
+        req->on_decoded = std::move(on_decoded);
+        req->decoding = jobs.async([req]() { req->is_loaded = req->image.loadFromFile(req->path); });
+        pending.push_back(std::move(req));
+    }
+
+    /*!
+    Calls back for every decoded image, must be called on the render thread.
+    Without workers the images are decoded here. Returns the number of images still pending.
+    */
+    size_t upload_finished(JobSystem &jobs) {
+        size_t still_pending = 0;
+        for (auto &req : pending) {
+            if (jobs.thread_count() == 1) jobs.wait(req->decoding);
+            if (!req->decoding.is_done()) {
+                pending[still_pending++] = std::move(req);
+                continue;
+            }
+
+            if (req->is_loaded) {
+                req->on_decoded(req->image);
+            } else {
+                std::cerr << "Could not load the image '" << req->path << "'" << std::endl;
+                failed.push_back(req->path);
+            }
+        }
+        pending.resize(still_pending);
+        return still_pending;
+    }
+
+    /*!
+    Waits for all the requested images and uploads them.
+    */
+    void finish(JobSystem &jobs) {
+        for (auto &req : pending) {
+            jobs.wait(req->decoding);
+        }
+        upload_finished(jobs);
+    }
+
+    bool is_done() const { return pending.empty(); }
+
+    /*!
+    Returns the paths of the images that could not be decoded.
+    */
+    const std::vector<std::string> &get_failed() const { return failed; }
+};
+
+#endif  // ASSET_LOADER_HPP
@@ -0,0 +1,178 @@
+#pragma once
+
+#ifndef BACKGROUND_SAVER_HPP
+#define BACKGROUND_SAVER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/*!
+Writes saves on its own thread, so the frame does not wait for the disk.
+The file is first written next to the target, flushed to the disk and then renamed
+over the target, so a crash in the middle never leaves a half written save.
+At most one save is written and one more is queued at a time,
+a newer request replaces the queued one.
+*/
+class BackgroundSaver {
+public:
+    enum class Status {
+        Idle,
+        Saving,
+        Saved,
+        Failed,
+    };
+
+    using Writer = std::function<void(std::ostream &)>;
+
+    BackgroundSaver() = default;
+    BackgroundSaver(const BackgroundSaver &) = delete;
+    BackgroundSaver &operator=(const BackgroundSaver &) = delete;
+
+    /*!
+    Finishes the queued saves and stops the thread.
+    */
+    ~BackgroundSaver() {
+        {
+            std::lock_guard<std::mutex> lck(mut);
+            is_stopping = true;
+        }
+        cv.notify_all();
+        if (thread.joinable()) thread.join();
+    }
+
+    /*!
+    Queues `write` to be called on the saver thread with the stream of the new file.
+    `write` owns everything it needs, it must not touch the live game state.
+    */
+    void save(const std::string &filename, Writer write) {
+        {
+            std::lock_guard<std::mutex> lck(mut);
+            queued = Job{filename, std::move(write)};
+            status = Status::Saving;
+            if (!thread.joinable()) thread = std::thread(&BackgroundSaver::run, this);
+        }
+        cv.notify_all();
+    }
+
+    /*!
+    Returns when there are no queued or running saves.
+    */
+    void wait() {
+        std::unique_lock<std::mutex> lck(mut);
+        cv.wait(lck, [this] { return !queued && !is_writing; });
+    }
+
+    Status get_status() const { return status; }
+
+    /*!
+    Returns the time since the last save was finished.
+    */
+    std::chrono::steady_clock::duration since_finished() const {
+        return std::chrono::steady_clock::now() - finished_at.load();
+    }
+
+    /*!
+    Writes the file through a temporary one, returns false on any failure.
+    */
+    static bool commit(const std::string &filename, const Writer &write) {
+        std::string temporary = filename + ".tmp";
+        try {
+            bool is_written = false;
+            {
+                std::ofstream ofs(temporary, std::ios::trunc);
+                if (ofs) {
+                    write(ofs);
+                    ofs.flush();
+                    is_written = (bool)ofs;
+                }
+            }
+            if (is_written && sync_to_disk(temporary)) {
+                std::filesystem::rename(temporary, filename);
+                return true;
+            }
+            std::cerr << "Failed to save '" << filename << "'" << std::endl;
+        } catch (const std::exception &err) {
+            std::cerr << "Failed to save '" << filename << "': " << err.what() << std::endl;
+        }
+        std::error_code ignored;
+        std::filesystem::remove(temporary, ignored);
+        return false;
+    }
+
+private:
+    struct Job {
+        std::string filename;
+        Writer write;
+    };
+
+    std::thread thread;
+    std::mutex mut;
+    std::condition_variable cv;
+    std::optional<Job> queued;
+    bool is_writing = false;
+    bool is_stopping = false;
+
+    std::atomic<Status> status = Status::Idle;
+    std::atomic<std::chrono::steady_clock::time_point> finished_at;
+
+    void run() {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lck(mut);
+                cv.wait(lck, [this] { return queued || is_stopping; });
+                if (!queued) return;
+                job = std::move(*queued);
+                queued.reset();
+                is_writing = true;
+            }
+
+            bool ok = commit(job.filename, job.write);
+            job = Job{};  // drops the snapshot before the next one is taken
+
+            {
+                std::lock_guard<std::mutex> lck(mut);
+                is_writing = false;
+                finished_at = std::chrono::steady_clock::now();
+                if (!queued) status = ok ? Status::Saved : Status::Failed;
+            }
+            cv.notify_all();
+        }
+    }
+
+    static bool sync_to_disk(const std::string &filename) {
+#ifdef _WIN32
+        int fd = _open(filename.c_str(), _O_RDWR);
+        if (fd == -1) return false;
+        bool ok = _commit(fd) == 0;
+        _close(fd);
+        return ok;
+#else
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd == -1) return false;
+        bool ok = fsync(fd) == 0;
+        close(fd);
+        return ok;
+#endif
+    }
+};
+
+#endif  // BACKGROUND_SAVER_HPP
@@ -0,0 +1,243 @@
+#pragma once
+
+#ifndef BEHAVIOUR_HPP
+#define BEHAVIOUR_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <utility>
+
+class BehaviourScheduler;
+
+/*!
+A behaviour coroutine. Behaviours can `co_await` other behaviours,
+the awaiting one continues when the awaited one returns.
+The coroutine starts suspended and is owned by the object.
+*/
+class Behaviour {
+public:
+    struct promise_type {
+        std::coroutine_handle<> continuation = std::noop_coroutine();
+
+        Behaviour get_return_object() {
+            return Behaviour(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle
+            ) noexcept {
+                return handle.promise().continuation;
+            }
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    Behaviour() = default;
+    Behaviour(const Behaviour &) = delete;
+    Behaviour &operator=(const Behaviour &) = delete;
+    Behaviour(Behaviour &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    Behaviour &operator=(Behaviour &&other) noexcept {
+        if (this != &other) {
+            reset();
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+    ~Behaviour() { reset(); }
+
+    explicit operator bool() const { return (bool)handle; }
+    bool is_done() const { return !handle || handle.done(); }
+
+    /*!
+    Starts the coroutine, it runs until its first wait.
+    */
+    void start() {
+        if (handle && !handle.done()) handle.resume();
+    }
+
+    void reset() {
+        if (handle) handle.destroy();
+        handle = nullptr;
+    }
+
+    // awaiting a behaviour runs it right away and continues when it returns
+    bool await_ready() const noexcept { return is_done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+    void await_resume() noexcept {}
+
+private:
+    std::coroutine_handle<promise_type> handle = nullptr;
+
+    explicit Behaviour(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+};
+
+/*!
+The state shared by the behaviours of one actor: what they are waiting for
+and where the actor should go. Behaviours only wait through the context,
+so the scheduler always knows which coroutine to resume and when.
+*/
+class BehaviourContext {
+public:
+    enum class Wait {
+        None,
+        Time,       // until the scheduler time reaches `wake_time`
+        Condition,  // until `condition` returns true, checked without resuming
+        Decision,   // until the scheduler has budget for an expensive decision
+    };
+
+    Wait wait = Wait::None;
+    float wake_time = 0.0f;
+    std::function<bool()> condition;
+    std::coroutine_handle<> resume_point = nullptr;
+    std::uint32_t waited_ticks = 0;
+
+    BehaviourContext() = default;
+    BehaviourContext(const BehaviourContext &) = delete;
+    BehaviourContext &operator=(const BehaviourContext &) = delete;
+    virtual ~BehaviourContext() = default;
+
+    struct Awaiter {
+        BehaviourContext &context;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) noexcept {
+            context.resume_point = handle;
+            context.waited_ticks = 0;
+        }
+        void await_resume() const noexcept {}
+    };
+
+    /*!
+    Resumes after `seconds` of the scheduler time.
+    */
+    Awaiter wait_for(float seconds) {
+        wait = Wait::Time;
+        wake_time = now + seconds;
+        return Awaiter{*this};
+    }
+
+    /*!
+    Resumes on the next tick.
+    */
+    Awaiter next_tick() { return wait_for(0.0f); }
+
+    /*!
+    Resumes once `fn` returns true, `fn` is checked every tick.
+    */
+    Awaiter wait_until(std::function<bool()> fn) {
+        wait = Wait::Condition;
+        condition = std::move(fn);
+        return Awaiter{*this};
+    }
+
+    /*!
+    Resumes when the scheduler can afford an expensive decision in this frame.
+    */
+    Awaiter decide() {
+        wait = Wait::Decision;
+        return Awaiter{*this};
+    }
+
+    float get_now() const { return now; }
+
+private:
+    float now = 0.0f;
+
+    friend class BehaviourScheduler;
+};
+
+/*!
+Resumes the behaviours whose waits have expired. The decisions are limited
+by a time budget per frame, the rest are moved to the next frames.
+A decision that waited for `max_postponed_ticks` runs regardless of the budget.
+`tick` can be called from several threads at once, then the budget can be
+overrun by at most one decision per thread.
+*/
+class BehaviourScheduler {
+public:
+    float decision_budget_us = 200.0f;
+    std::uint32_t max_postponed_ticks = 10;
+
+    BehaviourScheduler() = default;
+    BehaviourScheduler(const BehaviourScheduler &other) { *this = other; }
+    BehaviourScheduler &operator=(const BehaviourScheduler &other) {
+        decision_budget_us = other.decision_budget_us;
+        max_postponed_ticks = other.max_postponed_ticks;
+        now = other.now;
+        spent_ns.store(0, std::memory_order_relaxed);
+        return *this;
+    }
+
+    /*!
+    Advances the time and refills the budget, must be called once per frame before `tick`.
+    */
+    void begin_frame(float delta_time) {
+        now += delta_time;
+        spent_ns.store(0, std::memory_order_relaxed);
+    }
+
+    float get_now() const { return now; }
+
+    /*!
+    Resumes the behaviour of the context if its wait is over. Returns true if it was resumed.
+    */
+    bool tick(BehaviourContext &context) {
+        context.now = now;
+        if (!context.resume_point) return false;
+
+        bool is_decision = false;
+        if (context.wait == BehaviourContext::Wait::Time) {
+            if (now < context.wake_time) return false;
+        } else if (context.wait == BehaviourContext::Wait::Condition) {
+            if (context.condition && !context.condition()) return false;
+        } else if (context.wait == BehaviourContext::Wait::Decision) {
+            if (!has_budget() && context.waited_ticks < max_postponed_ticks) {
+                ++context.waited_ticks;
+                return false;
+            }
+            is_decision = true;
+        }
+
+        std::coroutine_handle<> handle = std::exchange(context.resume_point, nullptr);
+        context.wait = BehaviourContext::Wait::None;
+        context.condition = nullptr;
+
+        if (!is_decision) {
+            handle.resume();
+            return true;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        handle.resume();
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        spent_ns.fetch_add(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+            std::memory_order_relaxed
+        );
+        return true;
+    }
+
+    bool has_budget() const {
+        return (float)spent_ns.load(std::memory_order_relaxed) < decision_budget_us * 1000.0f;
+    }
+
+private:
+    float now = 0.0f;
+    std::atomic<std::int64_t> spent_ns = 0;
+};
+
+#endif  // BEHAVIOUR_HPP
@@ -0,0 +1,114 @@
+#pragma once
+
+#ifndef BODY_KERNELS_HPP
+#define BODY_KERNELS_HPP
+
+#include <cstddef>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BODY_KERNELS_AVX2
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BODY_KERNELS_SSE
+#endif
+
+/*
+All the kernels take the vectors as interleaved (x, y) floats, so `positions`,
+`velocities` and `accelerations` hold 2 * count floats and `frictions` holds count.
+Every body gets the friction, then a semi-implicit Euler step:
+    a -= v * friction;  v += a * dt;  p += v * dt;  a = 0;
+The friction force is proportional to the mass, so the mass cancels out.
+All the versions do the same operations in the same order, so without the contraction
+into fused multiply-adds they give bit for bit the same results.
+*/
+
+inline void step_bodies_scalar(
+    float *positions, float *velocities, float *accelerations, const float *frictions,
+    size_t count, float delta_time
+) {
+    for (size_t i = 0; i < 2 * count; ++i) {
+        float acceleration = accelerations[i] - velocities[i] * frictions[i / 2];
+        velocities[i] += acceleration * delta_time;
+        positions[i] += velocities[i] * delta_time;
+        accelerations[i] = 0.0f;
+    }
+}
+
+#ifdef BODY_KERNELS_SSE
+inline void step_bodies_sse(
+    float *positions, float *velocities, float *accelerations, const float *frictions,
+    size_t count, float delta_time
+) {
+    __m128 dt = _mm_set1_ps(delta_time);
+    __m128 zero = _mm_setzero_ps();
+
+    // two bodies at a time
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128 friction =
+            _mm_set_ps(frictions[i + 1], frictions[i + 1], frictions[i], frictions[i]);
+        __m128 v = _mm_loadu_ps(velocities + 2 * i);
+        __m128 a = _mm_sub_ps(_mm_loadu_ps(accelerations + 2 * i), _mm_mul_ps(v, friction));
+        v = _mm_add_ps(v, _mm_mul_ps(a, dt));
+        __m128 p = _mm_add_ps(_mm_loadu_ps(positions + 2 * i), _mm_mul_ps(v, dt));
+        _mm_storeu_ps(velocities + 2 * i, v);
+        _mm_storeu_ps(positions + 2 * i, p);
+        _mm_storeu_ps(accelerations + 2 * i, zero);
+    }
+    step_bodies_scalar(
+        positions + 2 * i, velocities + 2 * i, accelerations + 2 * i, frictions + i, count - i,
+        delta_time
+    );
+}
+#endif
+
+#ifdef BODY_KERNELS_AVX2
+inline void step_bodies_avx2(
+    float *positions, float *velocities, float *accelerations, const float *frictions,
+    size_t count, float delta_time
+) {
+    __m256 dt = _mm256_set1_ps(delta_time);
+    __m256 zero = _mm256_setzero_ps();
+
+    // four bodies at a time, the frictions are duplicated for both of the axes
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 four = _mm_loadu_ps(frictions + i);
+        __m256 friction =
+            _mm256_set_m128(_mm_unpackhi_ps(four, four), _mm_unpacklo_ps(four, four));
+        __m256 v = _mm256_loadu_ps(velocities + 2 * i);
+        __m256 a =
+            _mm256_sub_ps(_mm256_loadu_ps(accelerations + 2 * i), _mm256_mul_ps(v, friction));
+        v = _mm256_add_ps(v, _mm256_mul_ps(a, dt));
+        __m256 p = _mm256_add_ps(_mm256_loadu_ps(positions + 2 * i), _mm256_mul_ps(v, dt));
+        _mm256_storeu_ps(velocities + 2 * i, v);
+        _mm256_storeu_ps(positions + 2 * i, p);
+        _mm256_storeu_ps(accelerations + 2 * i, zero);
+    }
+    step_bodies_scalar(
+        positions + 2 * i, velocities + 2 * i, accelerations + 2 * i, frictions + i, count - i,
+        delta_time
+    );
+}
+#endif
+
+/*!
+Runs the widest kernel the build was compiled for.
+*/
+inline void step_bodies(
+    float *positions, float *velocities, float *accelerations, const float *frictions,
+    size_t count, float delta_time
+) {
+#if defined(BODY_KERNELS_AVX2)
+    step_bodies_avx2(positions, velocities, accelerations, frictions, count, delta_time);
+#elif defined(BODY_KERNELS_SSE)
+    step_bodies_sse(positions, velocities, accelerations, frictions, count, delta_time);
+#else
+    step_bodies_scalar(positions, velocities, accelerations, frictions, count, delta_time);
+#endif
+}
+
+#endif  // BODY_KERNELS_HPP
@@ -0,0 +1,113 @@
+#pragma once
+
+#ifndef BODY_STORE_HPP
+#define BODY_STORE_HPP
+
+#include <SFML/Graphics/Rect.hpp>
+#include <SFML/System/Vector2.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "body_kernels.hpp"
+
+/*!
+The data of one rigid body, see `RigidBody`.
+*/
+struct BodyData {
+    float size = 1.0f;
+    float mass = 1.0f;
+    float friction_coefficient = 2.0f;  // mu * gravity
+    sf::Vector2f position;
+    sf::Vector2f velocity;
+    sf::Vector2f acceleration;
+    std::uint8_t pushable = true;
+};
+
+/*!
+The data of rigid bodies, one array per field, so the physics passes
+stream through memory instead of striding over the whole objects.
+The store owns the data of the bodies bound to it, they read and write their rows.
+*/
+class BodyStore {
+public:
+    std::vector<sf::Vector2f> positions;
+    std::vector<sf::Vector2f> velocities;
+    std::vector<sf::Vector2f> accelerations;
+    std::vector<float> sizes;
+    std::vector<float> masses;
+    std::vector<float> frictions;
+    std::vector<std::uint8_t> pushable;
+
+    size_t size() const { return positions.size(); }
+
+    /*!
+    Resizes all the arrays, the new rows hold the data of a default body.
+    */
+    void resize(size_t count) {
+        BodyData body;
+        positions.resize(count, body.position);
+        velocities.resize(count, body.velocity);
+        accelerations.resize(count, body.acceleration);
+        sizes.resize(count, body.size);
+        masses.resize(count, body.mass);
+        frictions.resize(count, body.friction_coefficient);
+        pushable.resize(count, body.pushable);
+    }
+
+    BodyData read(size_t i) const {
+        BodyData body;
+        body.size = sizes[i];
+        body.mass = masses[i];
+        body.friction_coefficient = frictions[i];
+        body.position = positions[i];
+        body.velocity = velocities[i];
+        body.acceleration = accelerations[i];
+        body.pushable = pushable[i];
+        return body;
+    }
+
+    void write(size_t i, const BodyData &body) {
+        positions[i] = body.position;
+        velocities[i] = body.velocity;
+        accelerations[i] = body.acceleration;
+        sizes[i] = body.size;
+        masses[i] = body.mass;
+        frictions[i] = body.friction_coefficient;
+        pushable[i] = body.pushable;
+    }
+
+    /*!
+    The size is divided by `world_size`, same as the body does.
+    */
+    sf::FloatRect get_axes_aligned_bounding_box(size_t i, float world_size) const {
+        float size = sizes[i] / world_size;
+        return sf::FloatRect(positions[i].x - size / 2, positions[i].y - size / 2, size, size);
+    }
+
+    /*!
+    Integrates the bodies [begin, end) the same way `RigidBody::fixed_update` does.
+    */
+    void integrate(size_t begin, size_t end, float delta_time) {
+        for (size_t i = begin; i < end; ++i) {
+            velocities[i] += accelerations[i] * delta_time;
+            positions[i] += velocities[i] * delta_time;
+            accelerations[i] = sf::Vector2f(0, 0);
+        }
+    }
+
+    /*!
+    Applies the friction and integrates the bodies [begin, end) in one pass,
+    with the widest SIMD kernel available.
+    */
+    void step(size_t begin, size_t end, float delta_time) {
+        static_assert(sizeof(sf::Vector2f) == 2 * sizeof(float), "the vectors must be packed");
+        if (begin >= end) return;
+        step_bodies(
+            &positions[begin].x, &velocities[begin].x, &accelerations[begin].x, &frictions[begin],
+            end - begin, delta_time
+        );
+    }
+};
+
+#endif  // BODY_STORE_HPP
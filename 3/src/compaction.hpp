@@ -0,0 +1,140 @@
+#pragma once
+
+#ifndef COMPACTION_HPP
+#define COMPACTION_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "job_system.hpp"
+
+/*!
+Returns the number of chunks `parallel_compact` splits `count` items into.
+*/
+inline size_t compaction_chunk_count(size_t count, size_t chunk_size) {
+    chunk_size = chunk_size == 0 ? 1 : chunk_size;
+    return (count + chunk_size - 1) / chunk_size;
+}
+
+/*!
+Which items survive a compaction and where they go, see `plan_compaction`.
+Only the items from `first` on are looked at, the ones before it always stay.
+The survivors of chunk c are moved to [offsets[c], offsets[c + 1]).
+Keep one plan around between the compactions, so its arrays are not allocated every time.
+*/
+class CompactionPlan {
+public:
+    size_t first = 0;
+    size_t chunk_size = 1;
+    std::vector<std::uint8_t> keep;  // follows the items from `first`
+    std::vector<size_t> offsets;     // follows the chunks, one more at the end
+
+    size_t kept() const { return offsets.back(); }  // the items before `first` included
+    size_t removed() const { return first + keep.size() - kept(); }
+
+    /*!
+    Calls `move(from, to)` for every survivor that changes its index, in the increasing order.
+    The survivors before the first removed item stay where they are, so they are skipped
+    with the offsets of the chunks. Every `to` is below its `from` and above the previous one,
+    so the items can be moved in place.
+    */
+    template <typename Move>
+    void for_each_move(Move move) const {
+        size_t chunk = 0;
+        while (chunk + 1 < offsets.size() &&
+               offsets[chunk + 1] == first + (chunk + 1) * chunk_size)
+        {
+            ++chunk;
+        }
+        size_t to = offsets[chunk];
+        for (size_t i = chunk * chunk_size; i < keep.size(); ++i) {
+            if (!keep[i]) continue;
+            if (first + i != to) move(first + i, to);
+            ++to;
+        }
+    }
+};
+
+/*!
+Evaluates `is_removed(item)` in parallel for the items from `first` on,
+`on_removed(item, chunk_index)` is called for every removed item from the thread
+that handles its chunk, the chunks are counted from `first`.
+The offsets of the survivors are a prefix sum of the chunk counts.
+*/
+template <typename T, typename IsRemoved, typename OnRemoved>
+void plan_compaction(
+    JobSystem &jobs, std::vector<T> &items, size_t chunk_size, IsRemoved is_removed,
+    OnRemoved on_removed, CompactionPlan &plan, size_t first = 0
+) {
+    plan.first = std::min(first, items.size());
+    plan.chunk_size = chunk_size == 0 ? 1 : chunk_size;
+    size_t count = items.size() - plan.first;
+    size_t chunks = compaction_chunk_count(count, plan.chunk_size);
+    plan.keep.resize(count);
+    plan.offsets.assign(chunks + 1, 0);
+    plan.offsets[0] = plan.first;
+
+    jobs.parallel_for(chunks, 1, [&](size_t chunk) {
+        size_t begin = chunk * plan.chunk_size;
+        size_t end = std::min(count, begin + plan.chunk_size);
+        size_t kept = 0;
+        for (size_t i = begin; i < end; ++i) {
+            T &item = items[plan.first + i];
+            plan.keep[i] = !is_removed(item);
+            if (plan.keep[i]) {
+                ++kept;
+            } else {
+                on_removed(item, chunk);
+            }
+        }
+        plan.offsets[chunk + 1] = kept;
+    });
+
+    for (size_t chunk = 0; chunk < chunks; ++chunk) {
+        plan.offsets[chunk + 1] += plan.offsets[chunk];
+    }
+}
+
+/*!
+Moves the survivors of `plan` into place and drops the rest. `items` must have the size
+the plan was made for, so arrays that follow each other can be compacted with one plan.
+Nothing is allocated or constructed, only the survivors after the first removed item move.
+*/
+template <typename T>
+void apply_compaction(std::vector<T> &items, const CompactionPlan &plan) {
+    plan.for_each_move([&](size_t from, size_t to) { items[to] = std::move(items[from]); });
+    items.erase(items.begin() + plan.kept(), items.end());
+}
+
+/*!
+Removes the items for which `is_removed(item)` is true, keeping the order of the rest.
+The predicate is evaluated in parallel, `on_removed(item, chunk_index)` is called
+for every removed item from the thread that handles its chunk.
+The survivors are then moved in place to the offsets given by a prefix sum
+of the chunk counts, so nothing is moved at all when nothing is removed.
+Returns the number of removed items.
+*/
+template <typename T, typename IsRemoved, typename OnRemoved>
+size_t parallel_compact(
+    JobSystem &jobs, std::vector<T> &items, size_t chunk_size, IsRemoved is_removed,
+    OnRemoved on_removed, CompactionPlan &plan
+) {
+    plan_compaction(jobs, items, chunk_size, is_removed, on_removed, plan);
+    if (plan.removed() == 0) return 0;
+    apply_compaction(items, plan);
+    return plan.removed();
+}
+
+template <typename T, typename IsRemoved, typename OnRemoved>
+size_t parallel_compact(
+    JobSystem &jobs, std::vector<T> &items, size_t chunk_size, IsRemoved is_removed,
+    OnRemoved on_removed
+) {
+    CompactionPlan plan;
+    return parallel_compact(jobs, items, chunk_size, is_removed, on_removed, plan);
+}
+
+#endif  // COMPACTION_HPP
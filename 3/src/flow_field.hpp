@@ -0,0 +1,100 @@
+#pragma once
+
+#ifndef FLOW_FIELD_HPP
+#define FLOW_FIELD_HPP
+
+#include <SFML/System/Vector2.hpp>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/*!
+The direction towards a goal tile from every tile of a level, one byte per tile.
+It is built with a breadth-first search from the goal over the passable tiles,
+after that any number of actors can follow it with one lookup each.
+*/
+class FlowField {
+public:
+    static constexpr std::uint8_t at_goal = 8;
+    static constexpr std::uint8_t unreachable = 0xff;
+
+    // the orthogonal steps go first, so they are preferred over the diagonal ones
+    static constexpr std::array<std::pair<int, int>, 8> steps = {{
+        {1, 0},
+        {-1, 0},
+        {0, 1},
+        {0, -1},
+        {1, 1},
+        {1, -1},
+        {-1, 1},
+        {-1, -1},
+    }};
+
+    size_t width = 0;
+    size_t height = 0;
+    std::pair<size_t, size_t> goal;
+    bool is_computed = false;
+    std::vector<std::uint8_t> directions;  // index of the step, `at_goal` or `unreachable`
+
+    /*!
+    Fills the field towards `goal`. `passable` holds one byte per tile,
+    laid out the same way as `directions`, the tile (x, y) is at x * height + y.
+    The diagonal steps are not taken past the corners of the impassable tiles.
+    */
+    void compute(
+        const std::vector<std::uint8_t> &passable, size_t width, size_t height,
+        std::pair<size_t, size_t> goal
+    ) {
+        this->width = width;
+        this->height = height;
+        this->goal = goal;
+        is_computed = true;
+        directions.assign(width * height, unreachable);
+        if (goal.first >= width || goal.second >= height) return;
+
+        auto is_passable = [&](size_t x, size_t y) { return passable[x * height + y] != 0; };
+
+        frontier.clear();
+        directions[goal.first * height + goal.second] = at_goal;
+        frontier.push_back(goal.first * height + goal.second);
+
+        for (size_t next = 0; next < frontier.size(); ++next) {
+            size_t x = frontier[next] / height;
+            size_t y = frontier[next] % height;
+            for (std::uint8_t i = 0; i < steps.size(); ++i) {
+                // the neighbour gets back to this tile with the opposite step
+                size_t nx = x - steps[i].first;
+                size_t ny = y - steps[i].second;
+                if (nx >= width || ny >= height) continue;  // wraps around below zero
+                if (directions[nx * height + ny] != unreachable || !is_passable(nx, ny)) continue;
+                bool is_diagonal = steps[i].first != 0 && steps[i].second != 0;
+                if (is_diagonal && (!is_passable(nx, y) || !is_passable(x, ny))) continue;
+
+                directions[nx * height + ny] = i;
+                frontier.push_back(nx * height + ny);
+            }
+        }
+    }
+
+    std::uint8_t direction_at(size_t x, size_t y) const {
+        if (x >= width || y >= height) return unreachable;
+        return directions[x * height + y];
+    }
+
+    /*!
+    Returns the step to the next tile on the way to the goal,
+    zero if the tile is the goal itself or the goal can not be reached from it.
+    */
+    sf::Vector2f step_at(size_t x, size_t y) const {
+        std::uint8_t direction = direction_at(x, y);
+        if (direction >= steps.size()) return {0, 0};
+        return sf::Vector2f((float)steps[direction].first, (float)steps[direction].second);
+    }
+
+private:
+    std::vector<std::uint32_t> frontier;  // scratch space of the search
+};
+
+#endif  // FLOW_FIELD_HPP
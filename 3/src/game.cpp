@@ -74,76 +74,44 @@ void center_text_origin(sf::Text &text) {
 void setup_sprite(
     const sf::Texture &texture, sf::Sprite &sprite, sf::Vector2f relative_scale = {1.0f, 1.0f}
 ) {
-    sprite.setTexture(texture);
+    sprite.setTexture(texture, /*resetRect*/ true);
     sprite.setScale(relative_scale / sf::Vector2f(texture.getSize()));
     sprite.setOrigin(sf::Vector2f(texture.getSize()) / 2.0f);
 }
 
-Tile &Tile::set_building(std::shared_ptr<Chest> building) {
-    this->building = building;
-    return *this;
-}
-
-EnemyThreads::~EnemyThreads() {
-    shutdown();
-
-    for (auto &thread : threads) {
-        if (thread.joinable()) {
-            thread.join();
+/*!
+Fills the texture with a placeholder and calls `setup` on it,
+then does the same once the real image is decoded on the job system.
+*/
+void load_texture_async(
+    const std::string &file_name, sf::Texture &texture, std::function<void(sf::Texture &)> setup
+) {
+    texture.loadFromImage(AssetLoader::placeholder());
+    setup(texture);
+
+    Game &game = Game::get();
+    game.assets.request(
+        game.jobs, path_to_resources + file_name,
+        [&texture, setup](const sf::Image &image) {
+            texture.loadFromImage(image);
+            setup(texture);
         }
-    }
-}
-
-void EnemyThreads::init() {
-    threads.reserve(thread_count);
-    for (size_t i = 0; i < thread_count; ++i) {
-        threads.emplace_back(std::thread(&EnemyThreads::run, this, i));
-    }
+    );
 }
 
-void EnemyThreads::run(size_t id) {
-    while (1) {
-        {
-            std::unique_lock<std::mutex> lck(sync_mutex);
-            children_cv.wait(lck, [&] { return can_start_update || is_shutting_down; });
-            if (is_shutting_down) return;
-        }
-
-        Game::get().update_enemies_in_thread(delta_time, id);
-
-        sync_point->arrive_and_wait();
-    }
+Tile &Tile::set_building(std::shared_ptr<Chest> building) {
+    this->building = building;
+    return *this;
 }
 
-void EnemyThreads::start_updates() {
-    auto on_completion = [this]() noexcept {
-        // The work for this batch is done. Signal the main thread.
-        std::lock_guard<std::mutex> lck(sync_mutex);
-        can_start_update = false;
-        parent_cv.notify_one();
-    };
+bool Tile::is_passable() const { return kind != Barrier && kind != ClosedDor; }
 
-    sync_point = std::make_unique<std::barrier<std::function<void()>>>(thread_count, on_completion);
-
-    {
-        std::unique_lock<std::mutex> lck(sync_mutex);
-        can_start_update = true;
-    }
-    children_cv.notify_all();
-}
+DeepCopyCls(Tile) { other.building = building ? deepcopy_shared(*building) : nullptr; }
 
-void EnemyThreads::join_updates() {
-    std::unique_lock<std::mutex> lck(sync_mutex);
-    parent_cv.wait(lck, [&] { return !can_start_update; });
-}
+static thread_local Game *thread_game = nullptr;
 
-void EnemyThreads::shutdown() {
-    {
-        std::unique_lock<std::mutex> lck(sync_mutex);
-        can_start_update = false;
-        is_shutting_down = true;
-    }
-    children_cv.notify_all();
+Game::Game() {
+    jobs.on_worker_start = [this]() { thread_game = this; };
 }
 
 Game &Game::get(bool brand_new) {
@@ -153,9 +121,14 @@ Game &Game::get(bool brand_new) {
         game = std::make_shared<Game>();
     }
 
+    if (thread_game) return *thread_game;
     return *game;
 }
 
+Game::Scope::Scope(Game &game) : previous(thread_game) { thread_game = &game; }
+
+Game::Scope::~Scope() { thread_game = previous; }
+
 static const char *const logo_name = "rock_eyebrow_meme.png";
 static const char *const flor_tile_name = "dungeon_floor_4x4_yellow.png";
 static const char *const open_dor_tile_name = "dungeon_open_door.jpeg";
@@ -166,6 +139,7 @@ static const char *const down_laddor_tile_name = "down_ladder.jpeg";
 static const char *const chest_name = "chest.png";
 
 bool Game::init(unsigned int width, unsigned int height) {
+    jobs.init(thread_count);  // textures are decoded on the workers
     for (auto &it : actor_classes) {
         if (!it.init()) return false;
     }
@@ -173,10 +147,19 @@ bool Game::init(unsigned int width, unsigned int height) {
         if (!it.init()) return false;
     }
     dungeon.init();
-    enemy_threads.init();
     return game_view.init(width, height);
 }
 
+/*!
+Prepares the game to be simulated without a window, the textures are not loaded.
+*/
+bool Game::init_headless() {
+    is_headless = true;
+    jobs.init(thread_count);
+    dungeon.init();
+    return true;
+}
+
 void Game::start_playing() {
     if (is_in_game) return;
 
@@ -206,7 +189,27 @@ void Game::save(const std::string &filename) {
     // }
 }
 
+std::shared_ptr<SaveSnapshot> SaveSnapshot::of(const Game &game) {
+    return std::shared_ptr<SaveSnapshot>(new SaveSnapshot{
+        deepcopy(game.dungeon), game.actor_classes, game.player_template, game.enemy_templates,
+        game.item_classes, game.item_templates, game.fixed_delta_time_leftover,
+        game.is_inventory_selected, game.time_scale, game.time_scale_epsilon
+    });
+}
+
+void Game::save_in_background(const std::string &filename) {
+    // only the copy is taken on this thread, the archive is written on the saver thread
+    std::shared_ptr<SaveSnapshot> snapshot = SaveSnapshot::of(*this);
+    saver.save(filename, [this, snapshot](std::ostream &os) {
+        Scope scope(*this);
+        boost::archive::text_oarchive oa(os);
+        oa << *snapshot;
+    });
+}
+
 void Game::load(const std::string &filename) {
+    // the pending decodes write into the textures of the classes that are about to be replaced
+    assets.finish(jobs);
     TRY_CATCH_ALL({
         std::ifstream ifs(filename);
         boost::archive::text_iarchive ia(ifs);
@@ -225,8 +228,8 @@ void Game::setup_default_actors() {
 
     enemy_templates.resize(actor_classes.size());
     player_template = Player(player_id, 10.0f, Characteristics(100.0f, 4.0f, 5.0f), 0);
-    player_template.pushable = false;
-    player_template.mass = 10000.0f;
+    player_template.pushable() = false;
+    player_template.mass() = 10000.0f;
     enemy_templates[pepe_id] = Enemy(pepe_id, 5.0f, Characteristics(40.0f, 0.0f, 4.0f), 1);
     enemy_templates[goblin_id] = Enemy(goblin_id, 7.0f, Characteristics(40.0f, 2.0f, 2.0f), 2);
 }
@@ -281,10 +284,11 @@ void Game::setup_default_items() {
 
 void Game::handle_save_load() {
     if (keys_pressed_on_this_frame[sf::Keyboard::L]) {
+        saver.wait();
         load("save.txt");
     }
     if (keys_pressed_on_this_frame[sf::Keyboard::O]) {
-        save("save.txt");
+        save_in_background("save.txt");
     }
 }
 
@@ -333,7 +337,20 @@ T get_as_or__with_typename(P &parent, const char *path, const char *type_name, T
     get_as_or__with_typename<T>(table, path, #T, default_value)
 
 template <typename P>
-void load_level_from_config(P parent, Dungeon &dungeon) {
+void load_work_limits_from_config(P &parent, WorkLimits &limits) {
+    if (auto value = get_as(parent, "threads.max_per_phase", size_t); value) {
+        limits.max_threads = *value;
+    }
+    if (auto value = get_as(parent, "threads.serial_below_us", double); value) {
+        limits.serial_below_us = *value;
+    }
+    if (auto value = get_as(parent, "threads.chunk_us", double); value) {
+        limits.chunk_us = *value;
+    }
+}
+
+template <typename P>
+DungeonLevel load_level_from_config(P parent) {
     DungeonLevel level;
     if (auto value = get_as(parent, "actors_spawned_per_class", size_t); value) {
         level.actors_spawned_per_class = *value;
@@ -341,10 +358,22 @@ void load_level_from_config(P parent, Dungeon &dungeon) {
     if (auto value = get_as(parent, "laying_items_spawned_per_class", size_t); value) {
         level.laying_items_spawned_per_class = *value;
     }
+    if (auto value = get_as(parent, "laying_item_merge_radius", float); value) {
+        level.laying_item_merge_radius = *value;
+    }
+    if (auto value = get_as(parent, "max_laying_items", size_t); value) {
+        level.max_laying_items = *value;
+    }
     size_t size = get_as_or(parent, "size", size_t, 30);
     level.resize_tiles(size, size);
-    level.regenerate();
-    dungeon.add_level(level);
+    return level;
+}
+
+std::uint32_t level_seed(std::uint32_t base_seed, size_t level_index) {
+    std::seed_seq seq{base_seed, (std::uint32_t)level_index};
+    std::uint32_t seed;
+    seq.generate(&seed, &seed + 1);
+    return seed;
 }
 
 bool Game::load_config(const std::string &filename) {
@@ -360,14 +389,45 @@ bool Game::load_config(const std::string &filename) {
     std::string item_plugins_directory =
         get_as_or(table, "item_plugins_directory", std::string, "item_plugins");
 
+    if (auto value = get_as(table, "threads.count", size_t); value && *value != 0) {
+        thread_count = *value;
+    }
+    load_work_limits_from_config(table, enemy_update_tuner.limits);
+    load_work_limits_from_config(table, enemy_fixed_update_tuner.limits);
+    float decision_budget_us = get_as_or(table, "behaviours.decision_budget_us", float, 200.0f);
+    LevelOfDetail lod;
+    lod.half_rate = get_as_or(table, "ai_lod.half_rate", float, lod.half_rate);
+    lod.quarter_rate = get_as_or(table, "ai_lod.quarter_rate", float, lod.quarter_rate);
+    lod.eighth_rate = get_as_or(table, "ai_lod.eighth_rate", float, lod.eighth_rate);
+    lod.dormant = get_as_or(table, "ai_lod.dormant", float, lod.dormant);
+    PathService paths;
+    paths.cluster_size = get_as_or(table, "pathfinding.cluster_size", size_t, paths.cluster_size);
+    paths.get_cache().capacity =
+        get_as_or(table, "pathfinding.cache_size", size_t, paths.get_cache().capacity);
+    dungeon.simulate_background_levels = get_as_or(
+        table, "background.simulate", bool, dungeon.simulate_background_levels
+    );
+    dungeon.background_tick_time =
+        get_as_or(table, "background.tick_time", float, dungeon.background_tick_time);
+    dungeon.background_tick_budget_us =
+        get_as_or(table, "background.tick_budget_us", float, dungeon.background_tick_budget_us);
+
     setup_default_actors();
     load_item_plugins(item_plugins_directory);
     setup_default_items();
 
+    std::vector<DungeonLevel> levels;
+    std::vector<std::uint32_t> seeds;
+    std::uint32_t base_seed = get_as_or(table, "seed", std::uint32_t, std::random_device()());
+
     if (auto arr = get_as_array(table, "levels"); arr) {
         arr->for_each([&](auto &&el) {
             if constexpr (toml::is_table<decltype(el)>) {
-                load_level_from_config(el, dungeon);
+                levels.push_back(load_level_from_config(el));
+                levels.back().paths = paths;  // before the graph is built by `regenerate`
+                seeds.push_back(
+                    get_as_or(el, "seed", std::uint32_t, level_seed(base_seed, seeds.size()))
+                );
             } else {
                 std::cerr << "TypeError: all 'levels' items must be arrays, not " << el.type()
                           << std::endl;
@@ -375,6 +435,15 @@ bool Game::load_config(const std::string &filename) {
         });
     }
 
+    // every level has its own seed, so the result is the same as generating them one by one
+    jobs.init(thread_count);
+    jobs.parallel_for(levels.size(), 1, [&](size_t i) { levels[i].regenerate(seeds[i]); });
+    for (auto &level : levels) {
+        level.behaviours.decision_budget_us = decision_budget_us;
+        level.lod = lod;
+        dungeon.add_level(level);
+    }
+
     return true;
 }
 
@@ -420,12 +489,13 @@ void Game::handle_events() {
 
 bool Game::is_playing() const { return dungeon.player.alive && !have_won; }
 
-void Game::update(float delta_time) { dungeon.update(delta_time); }
-
-void Game::update_enemies_in_thread(float delta_time, size_t id) {
-    dungeon.update_enemies_in_thread(delta_time, id);
+void Game::step(float delta_time) {
+    update(delta_time);
+    handle_fixed_update(delta_time);
 }
 
+void Game::update(float delta_time) { dungeon.update(delta_time); }
+
 void Game::handle_fixed_update(float delta_time) {
     fixed_delta_time_leftover += delta_time;
     while (fixed_delta_time_leftover >= fixed_delta_time) {
@@ -440,19 +510,26 @@ bool Game::run() {
     while (game_view.is_open()) {
         handle_events();
         handle_save_load();
+        assets.upload_finished(jobs);
+
+        // the frame is drawn from a snapshot of the world,
+        // so the next simulation step can run while the frame is being drawn
+        game_view.extract_frame();
 
+        JobSystem::Handle simulation;
         accumulated_time += time_scale;
         if (accumulated_time >= (1.0f - time_scale_epsilon) && is_playing()) {
             accumulated_time = 0.0f;
             float delta_time = clock.restart().asSeconds();
             delta_time *= time_scale;
-            update(delta_time);
-            handle_fixed_update(delta_time);
+            simulation = jobs.async([this, delta_time]() { step(delta_time); });
         }
 
         game_view.clear();
-        game_view.draw();
+        game_view.draw_frame();
         game_view.display();
+
+        jobs.wait(simulation);
     }
 
     return true;
@@ -510,10 +587,12 @@ bool GameView::init(unsigned int width, unsigned int height) {
     holder_of_items_view.init();
     experience_view.init();
 
-    if (!logo_texture.loadFromFile(path_to_resources + logo_name)) return false;
     float scale = max(sf::Vector2f(view.getSize())) / 3.0f;
-    setup_sprite(logo_texture, logo, {scale, scale});
-    logo.setPosition({view.getSize().x / 2.0f, view.getSize().y * 2.0f / 3.0f});
+    sf::Vector2f logo_position(view.getSize().x / 2.0f, view.getSize().y * 2.0f / 3.0f);
+    load_texture_async(logo_name, logo_texture, [this, scale, logo_position](sf::Texture &texture) {
+        setup_sprite(texture, logo, {scale, scale});
+        logo.setPosition(logo_position);
+    });
 
     menu_message.setFont(font);
     menu_message.setCharacterSize(40);
@@ -550,6 +629,15 @@ bool GameView::init(unsigned int width, unsigned int height) {
         sf::Vector2f(Game::view_size, Game::view_size) / (float)std::min(width, height)
     );
 
+    save_status_message.setFont(font);
+    save_status_message.setCharacterSize(30);
+    save_status_message.setFillColor(sf::Color::White);
+    save_status_message.setOutlineThickness(3);
+    save_status_message.setOutlineColor(sf::Color::Black);
+    save_status_message.setScale(
+        sf::Vector2f(Game::view_size, Game::view_size) / (float)std::min(width, height)
+    );
+
     return true;
 }
 
@@ -565,8 +653,58 @@ sf::FloatRect GameView::get_display_rect(float scale) const {
     return sf::FloatRect(pos.x - size.x / 2.0f, pos.y - size.y / 2.0f, size.x, size.y);
 }
 
+void GameView::extract_frame() {
+    Game &game = Game::get();
+    frame.is_in_game = game.is_in_game;
+    frame.has_level = (bool)game.dungeon.current_level;
+    if (!frame.is_in_game || !frame.has_level) return;
+
+    const Player &player = game.dungeon.player;
+
+    float ratio = (float)window.getSize().x / (float)window.getSize().y;
+    view.setSize(sf::Vector2f(Game::view_size * ratio, Game::view_size));
+    view.setCenter(sf::Vector2f(player.position()));
+
+    dungeon_level_view.extract(*game.dungeon.current_level, frame);
+
+    frame.slots.clear();
+    if (game.is_inventory_selected) {
+        for (const auto &slot : player.inventory.slots) {
+            frame.slots.push_back(SlotSprite::of(slot));
+        }
+        frame.selection = player.inventory.selection;
+    } else {
+        for (const auto &slot : player.equipment.slots) {
+            frame.slots.push_back(SlotSprite::of(slot));
+        }
+        frame.selection = player.equipment.selection;
+    }
+    frame.experience = player.experience;
+
+    frame.player_position = player.position();
+    frame.player_alive = player.alive;
+    frame.have_won = game.have_won;
+
+    frame.save_status.clear();
+    BackgroundSaver::Status save_status = game.saver.get_status();
+    if (save_status == BackgroundSaver::Status::Saving) {
+        frame.save_status = "Saving...";
+    } else if (save_status == BackgroundSaver::Status::Failed) {
+        frame.save_status = "Save failed";
+    } else if (save_status == BackgroundSaver::Status::Saved &&
+               game.saver.since_finished() < std::chrono::seconds(2))
+    {
+        frame.save_status = "Saved";
+    }
+}
+
 void GameView::draw() {
-    if (!Game::get().is_in_game) {
+    extract_frame();
+    draw_frame();
+}
+
+void GameView::draw_frame() {
+    if (!frame.is_in_game) {
         window.draw(logo);
         window.draw(menu_message);
 
@@ -575,8 +713,7 @@ void GameView::draw() {
         return;
     }
 
-    auto &level = Game::get().dungeon.current_level;
-    if (!level) {
+    if (!frame.has_level) {
         info_message.setString("No levels are loaded");
         center_text_origin(info_message);
         window.draw(info_message);
@@ -586,39 +723,34 @@ void GameView::draw() {
         return;
     }
 
-    float ratio = (float)window.getSize().x / (float)window.getSize().y;
-    view.setSize(sf::Vector2f(Game::view_size * ratio, Game::view_size));
-    view.setCenter(sf::Vector2f(Game::get().dungeon.player.position));
     window.setView(view);
 
-    dungeon_level_view.draw(*level);
-    if (Game::get().is_inventory_selected) {
-        Inventory &inventory = Game::get().dungeon.player.inventory;
-        holder_of_items_view.draw(
-            inventory.slots.data(), inventory.slots.size(), inventory.selection
-        );
-    } else {
-        Equipment &equipment = Game::get().dungeon.player.equipment;
-        holder_of_items_view.draw(
-            equipment.slots.data(), equipment.slots.size(), equipment.selection
-        );
-    }
-    experience_view.draw(Game::get().dungeon.player.experience);
+    dungeon_level_view.draw(frame);
+    holder_of_items_view.draw(frame.slots, frame.selection);
+    experience_view.draw(frame.experience);
 
-    if (!Game::get().dungeon.player.alive) {
+    if (!frame.player_alive) {
         important_message.setString("YOU DIED");
         center_text_origin(important_message);
-        important_message.setPosition(sf::Vector2f(Game::get().dungeon.player.position));
+        important_message.setPosition(frame.player_position);
         important_message.setFillColor(sf::Color::Red);
         window.draw(important_message);
-    } else if (Game::get().have_won) {
+    } else if (frame.have_won) {
         important_message.setString("YOU WON");
         center_text_origin(important_message);
-        important_message.setPosition(sf::Vector2f(Game::get().dungeon.player.position));
+        important_message.setPosition(frame.player_position);
         important_message.setFillColor(sf::Color::Green);
         window.draw(important_message);
     }
 
+    if (!frame.save_status.empty()) {
+        save_status_message.setString(frame.save_status);
+        float width = save_status_message.getGlobalBounds().width;
+        sf::Vector2f corner(view.getSize().x / 2 - width * 1.1f, -view.getSize().y / 2);
+        save_status_message.setPosition(view.getCenter() + corner);
+        window.draw(save_status_message);
+    }
+
 #ifdef DEBUG
     for (auto &point : debug_points) {
         debug_draw_point(point);
@@ -738,8 +870,9 @@ float calculate_inventory_item_x(float length, size_t count, size_t i) {
 
 void HolderOfItemsView::init() { stack_of_items_view.init(); }
 
-void HolderOfItemsView::draw(const StackOfItems *slots, size_t count, size_t selection) {
+void HolderOfItemsView::draw(const std::vector<SlotSprite> &slots, size_t selection) {
     sf::View view = Game::get().game_view.view;
+    size_t count = slots.size();
 
     float actual_size = item_size / Game::world_size;
 
@@ -788,18 +921,38 @@ void Dungeon::init() {
     Game::get().dungeon.player.init();
 }
 
+DeepCopyCls(Dungeon) {
+    for (size_t i = 0; i < all_levels.size(); ++i) {
+        all_levels[i].deepcopy_to(other.all_levels[i]);
+    }
+    if (current_level) current_level->deepcopy_to(*other.current_level);
+    player.deepcopy_to(other.player);
+}
+
 void Dungeon::update(float delta_time) {
+    // the background levels share nothing with the current one,
+    // so they are simulated on a worker while the current level is updated
+    JobSystem &jobs = Game::get().jobs;
+    if (simulate_background_levels) {
+        background = jobs.async([this, delta_time]() { update_background_levels(delta_time); });
+    }
     if (current_level) {
         current_level->update(delta_time);
     }
+    wait_background_levels();
 }
 
-void Dungeon::update_enemies_in_thread(float delta_time, size_t id) {
-    if (current_level) {
-        current_level->update_enemies_in_thread(delta_time, id);
+void Dungeon::update_background_levels(float delta_time) {
+    for (size_t i = 0; i < all_levels.size(); ++i) {
+        if ((long)i == current_level_index) continue;
+        all_levels[i].background_update(
+            delta_time, background_tick_time, background_tick_budget_us
+        );
     }
 }
 
+void Dungeon::wait_background_levels() { Game::get().jobs.wait(background); }
+
 void Dungeon::fixed_update(float delta_time) {
     if (current_level) {
         current_level->fixed_update(delta_time);
@@ -812,6 +965,20 @@ void DungeonLevel::init() {
     }
 }
 
+DeepCopyCls(DungeonLevel) {
+    for (size_t i = 0; i < enemies.size(); ++i) {
+        enemies[i].deepcopy_to(other.enemies[i]);
+    }
+    for (size_t i = 0; i < laying_items.size(); ++i) {
+        laying_items[i].deepcopy_to(other.laying_items[i]);
+    }
+    for (size_t i = 0; i < tiles.row_count(); ++i) {
+        for (size_t j = 0; j < tiles.column_count(); ++j) {
+            tiles[i][j].deepcopy_to(other.tiles[i][j]);
+        }
+    }
+}
+
 float DungeonLevel::tile_coords_to_world_coords_factor() const {
     return tile_size / Game::world_size;
 }
@@ -824,10 +991,10 @@ sf::Vector2f DungeonLevel::center() const {
 boost::optional<std::pair<size_t, size_t>> DungeonLevel::get_tile_coordinates(sf::Vector2f position
 ) const {
     sf::Vector2f world_coords = position / tile_coords_to_world_coords_factor();
-    if (position.x < 0 || position.x >= tiles.row_count() || position.y < 0 ||
-        position.y >= tiles.column_count())
+    if (world_coords.x < 0 || world_coords.x >= tiles.row_count() || world_coords.y < 0 ||
+        world_coords.y >= tiles.column_count())
         return boost::none;
-    return std::make_pair<size_t, size_t>(position.x, position.y);
+    return std::make_pair<size_t, size_t>(world_coords.x, world_coords.y);
 }
 
 Tile *DungeonLevel::get_tile(sf::Vector2f position) {
@@ -836,15 +1003,76 @@ Tile *DungeonLevel::get_tile(sf::Vector2f position) {
     return &tiles[coords->first][coords->second];
 }
 
-void DungeonLevel::resize_tiles(size_t width, size_t height) { tiles.resize(width, height); }
+void DungeonLevel::resize_tiles(size_t width, size_t height) {
+    tiles.resize(width, height);
+    rebuild_chest_index();
+    paths.invalidate();
+    solid_tiles.clear();
+}
+
+/*!
+Sets the building of the tile and keeps the index of the chests up to date,
+the buildings of the level should only be changed through it.
+*/
+void DungeonLevel::set_building(size_t x, size_t y, std::shared_ptr<Chest> building) {
+    tiles[x][y].set_building(building);
+
+    std::pair<std::uint32_t, std::uint32_t> key(x, y);
+    auto it = std::lower_bound(chest_tiles.begin(), chest_tiles.end(), key);
+    bool is_indexed = it != chest_tiles.end() && *it == key;
+    if (building && !is_indexed) {
+        chest_tiles.insert(it, key);
+    } else if (!building && is_indexed) {
+        chest_tiles.erase(it);
+    }
+}
+
+void DungeonLevel::rebuild_chest_index() {
+    chest_tiles.clear();
+    for (size_t i = 0; i < tiles.row_count(); ++i) {
+        for (size_t j = 0; j < tiles.column_count(); ++j) {
+            if (tiles[i][j].building) chest_tiles.emplace_back(i, j);
+        }
+    }
+}
+
+/*!
+Returns the coordinates of the closest tile with a chest at most `radius` tiles away.
+Of the equally close ones the first in the order of the tiles is returned.
+*/
+boost::optional<std::pair<size_t, size_t>> DungeonLevel::find_nearest_chest(
+    size_t x, size_t y, float radius
+) const {
+    boost::optional<std::pair<size_t, size_t>> result;
+    float best = radius * radius;
+
+    // the chests are sorted by x, so only the band [x - radius, x + radius] is visited
+    long reach = (long)std::floor(radius);
+    std::uint32_t first_x = (long)x > reach ? (std::uint32_t)(x - reach) : 0;
+    auto it = std::lower_bound(
+        chest_tiles.begin(), chest_tiles.end(), std::make_pair(first_x, std::uint32_t(0))
+    );
+    for (; it != chest_tiles.end() && (long)it->first <= (long)x + reach; ++it) {
+        float distance = length_squared(sf::Vector2f(it->first, it->second) - sf::Vector2f(x, y));
+        if (distance <= best && (!result || distance < best)) {
+            best = distance;
+            result = std::make_pair<size_t, size_t>(it->first, it->second);
+        }
+    }
+    return result;
+}
 
-void DungeonLevel::regenerate() {
-    regenerate_tiles();
-    regenerate_enemies();
-    regenerate_laying_items();
+void DungeonLevel::regenerate() { regenerate(std::random_device()()); }
+
+void DungeonLevel::regenerate(std::uint32_t seed) {
+    // one stream per level, so levels can be generated in any order and on any thread
+    std::mt19937 gen(seed);
+    regenerate_tiles(gen);
+    regenerate_enemies(gen);
+    regenerate_laying_items(gen);
 }
 
-void DungeonLevel::regenerate_tiles() {
+void DungeonLevel::regenerate_tiles(std::mt19937 &gen) {
     RangeOfLong range_chest_spawn(0, 50);
     RangeOfLong range_chest_level(0, (max_chest_level + 1) * (max_chest_level + 1) - 1);
     RangeOfLong range_chest_item(0, Game::get().item_templates.size() - 1);
@@ -856,11 +1084,11 @@ void DungeonLevel::regenerate_tiles() {
             else
                 tiles[i][j].kind = Tile::Flor;
 
-            if (tiles[i][j].kind == Tile::Flor && range_chest_spawn.get_random() == 0) {
-                size_t level = max_chest_level - (size_t)std::sqrt(range_chest_level.get_random());
+            if (tiles[i][j].kind == Tile::Flor && range_chest_spawn.get_random(gen) == 0) {
+                size_t level = max_chest_level - (size_t)std::sqrt(range_chest_level.get_random(gen));
                 auto chest = std::make_shared<Chest>(level);
-                chest->inventory.add_item(Game::get().make_item(range_chest_item.get_random()));
-                tiles[i][j].set_building(chest);
+                chest->inventory.add_item(Game::get().make_item(range_chest_item.get_random(gen)));
+                set_building(i, j, chest);
             }
         }
     }
@@ -868,13 +1096,13 @@ void DungeonLevel::regenerate_tiles() {
     RangeOfLong range_x(0, tiles.row_count() - 1);
     RangeOfLong range_y(0, tiles.column_count() - 1);
 
-    long x1 = range_x.get_random();
-    long y1 = range_y.get_random();
+    long x1 = range_x.get_random(gen);
+    long y1 = range_y.get_random(gen);
     tiles[x1][y1].kind = Tile::UpLaddor;
     initial_player_position = sf::Vector2f(x1, y1) * tile_coords_to_world_coords_factor();
 
-    long x2 = range_x.get_random();
-    long y2 = range_y.get_random();
+    long x2 = range_x.get_random(gen);
+    long y2 = range_y.get_random(gen);
     if (x1 == x2) {
         if (x2 == 0) {
             x2 += 1;
@@ -893,10 +1121,14 @@ void DungeonLevel::regenerate_tiles() {
 
     // tiles[4][4].kind = Tile::OpenDor;
     // tiles[4][5].kind = Tile::ClosedDor;
+
+    paths.rebuild(get_passable_tiles(), tiles.row_count(), tiles.column_count());
+    solid_tiles.clear();
 }
 
-void DungeonLevel::regenerate_enemies() {
+void DungeonLevel::regenerate_enemies(std::mt19937 &gen) {
     enemies.clear();
+    dormant_count = 0;
 
     RangeOfFloat range_x(2, tiles.row_count() - 2);
     RangeOfFloat range_y(2, tiles.column_count() - 2);
@@ -904,13 +1136,14 @@ void DungeonLevel::regenerate_enemies() {
     for (size_t class_index = 1; class_index < Game::get().actor_classes.size(); ++class_index) {
         for (size_t i = 0; i < actors_spawned_per_class; ++i) {
             Enemy &enemy = enemies.emplace_back(Game::get().make_enemy(class_index));
-            enemy.position = sf::Vector2f(range_x.get_random(), range_y.get_random());
-            enemy.position *= tile_coords_to_world_coords_factor();
+            enemy.position() = sf::Vector2f(range_x.get_random(gen), range_y.get_random(gen));
+            enemy.position() *= tile_coords_to_world_coords_factor();
+            enemy.seed = gen();
         }
     }
 }
 
-void DungeonLevel::regenerate_laying_items() {
+void DungeonLevel::regenerate_laying_items(std::mt19937 &gen) {
     laying_items.clear();
 
     RangeOfFloat range_x(2, tiles.row_count() - 2);
@@ -920,209 +1153,756 @@ void DungeonLevel::regenerate_laying_items() {
         for (size_t i = 0; i < laying_items_spawned_per_class; ++i) {
             LayingItem &litem =
                 laying_items.emplace_back(LayingItem(Game::get().make_item(class_index)));
-            litem.position = sf::Vector2f(range_x.get_random(), range_y.get_random());
-            litem.position *= tile_coords_to_world_coords_factor();
+            litem.position() = sf::Vector2f(range_x.get_random(gen), range_y.get_random(gen));
+            litem.position() *= tile_coords_to_world_coords_factor();
+            litem.generated = true;
         }
     }
 }
 
-void DungeonLevel::update(float delta_time) {
-    Game::get().enemy_threads.delta_time = delta_time;
-    Game::get().enemy_threads.start_updates();
-    Game::get().enemy_threads.join_updates();
+/*!
+Returns one byte per tile, the tile (x, y) is at x * column_count + y.
+*/
+std::vector<std::uint8_t> DungeonLevel::get_passable_tiles() const {
+    size_t height = tiles.column_count();
+    std::vector<std::uint8_t> passable(tiles.row_count() * height);
+    for (size_t x = 0; x < tiles.row_count(); ++x) {
+        for (size_t y = 0; y < height; ++y) {
+            passable[x * height + y] = tiles[x][y].is_passable();
+        }
+    }
+    return passable;
+}
 
-    Game::get().dungeon.player.update(delta_time);
+sf::Vector2f DungeonLevel::tile_center(TileCoords tile) const {
+    sf::Vector2f coords((float)tile.first + 0.5f, (float)tile.second + 0.5f);
+    return coords * tile_coords_to_world_coords_factor();
+}
+
+/*!
+Starts computing the flow field on a worker when the player got to another tile.
+The enemies follow the previous field until the new one is ready.
+*/
+void DungeonLevel::update_flow_field() {
+    JobSystem &jobs = Game::get().jobs;
+    if (!flow_field_job.is_done()) return;
+    wait_flow_field();
+
+    auto goal = get_tile_coordinates(world_state.read().player.position);
+    if (!goal) return;
+    size_t width = tiles.row_count();
+    size_t height = tiles.column_count();
+    if (flow_field.is_computed && flow_field.goal == *goal && flow_field.width == width &&
+        flow_field.height == height)
+        return;
+
+    // the worker gets its own copy of the tiles, so they can change in the meantime
+    std::vector<std::uint8_t> passable = get_passable_tiles();
+    auto field = std::make_shared<FlowField>();
+    std::pair<size_t, size_t> target = *goal;
+    flow_field_job = jobs.async([field, passable = std::move(passable), width, height, target]() {
+        field->compute(passable, width, height, target);
+    });
+    next_flow_field = field;
 
-    for (auto &enemy : enemies) {
-        enemy.apply_friction();
+    // with no workers nobody else would run the job
+    if (jobs.thread_count() <= 1) wait_flow_field();
+}
+
+void DungeonLevel::wait_flow_field() {
+    Game::get().jobs.wait(flow_field_job);
+    if (next_flow_field) {
+        flow_field = *next_flow_field;
+        next_flow_field.reset();
     }
-    Game::get().dungeon.player.apply_friction();
+}
 
+/*!
+Returns the way to the center of the next tile towards the player,
+zero if the flow field does not lead anywhere from the position.
+*/
+sf::Vector2f DungeonLevel::flow_direction(sf::Vector2f position) const {
+    auto coords = get_tile_coordinates(position);
+    if (!coords) return {0, 0};
+
+    sf::Vector2f step = flow_field.step_at(coords->first, coords->second);
+    if (step == sf::Vector2f(0, 0)) return step;
+
+    TileCoords next(coords->first + (long)step.x, coords->second + (long)step.y);
+    return tile_center(next) - position;
+}
+
+/*!
+Gives the paths requested during the frame to the workers,
+the graph is built first if the tiles have changed.
+*/
+void DungeonLevel::update_paths() {
+    if (!paths.has_graph()) {
+        paths.rebuild(get_passable_tiles(), tiles.row_count(), tiles.column_count());
+    }
+    paths.dispatch(Game::get().jobs);
+}
+
+/*!
+Finds out which of the active enemies see the player, in one batch before they think.
+An enemy sees the player within its sight radius if no barrier or closed door is in the way.
+*/
+void DungeonLevel::update_perception() {
+    if (!solid_tiles.has_been_built()) {
+        solid_tiles.build(get_passable_tiles(), tiles.row_count(), tiles.column_count());
+        player_visibility.forget();
+    }
+    // a copied level keeps its solid tiles, but not the results
+    if (player_visibility.get_size() != tiles.size()) player_visibility.resize(tiles.size());
+
+    const ActorState &player = world_state.read().player;
+    auto target = get_tile_coordinates(player.position);
+    if (target) player_visibility.set_target(*target);
+
+    size_t first = dormant_count;
+    Game::get().jobs.parallel_for(enemies.size() - first, bodies_per_job, [&](size_t k) {
+        Enemy &enemy = enemies[first + k];
+        EnemyBrain *mind = enemy.brain.get();
+        enemy.sees_player = false;
+        if (!target || !mind) return;
+        float radius = mind->sight_radius;
+        if (length_squared(player.position - enemy.position()) > radius * radius) return;
+
+        auto from = get_tile_coordinates(enemy.position());
+        enemy.sees_player = from && player_visibility.sees_target(solid_tiles, *from);
+    });
+}
+
+/*!
+Asks for the path between the tiles of the positions, can be called from any thread.
+Returns nullptr if any of them is outside of the level.
+*/
+std::shared_ptr<const PathRequest> DungeonLevel::request_path(sf::Vector2f from, sf::Vector2f to) {
+    auto start = get_tile_coordinates(from);
+    auto goal = get_tile_coordinates(to);
+    if (!start || !goal) return nullptr;
+    return paths.request(*start, *goal);
+}
+
+size_t DungeonLevel::region_of(sf::Vector2f position) const {
+    if (tiles.row_count() == 0 || tiles.column_count() == 0) return 0;
+    size_t side = std::max<size_t>(region_size, 1);
+    size_t region_columns = (tiles.column_count() + side - 1) / side;
+
+    // actors that got out of the level belong to the closest region
+    sf::Vector2f coords = position / tile_coords_to_world_coords_factor();
+    long x = std::clamp<long>((long)std::floor(coords.x), 0, (long)tiles.row_count() - 1);
+    long y = std::clamp<long>((long)std::floor(coords.y), 0, (long)tiles.column_count() - 1);
+    return (size_t)x / side * region_columns + (size_t)y / side;
+}
+
+/*!
+Keeps the dormant enemies first and the rest sorted by region, see `region_offsets`.
+The dormant enemies do not move, so on most frames only the rest are regrouped.
+All of them are sorted again only on the frames when a region wakes up or an enemy
+walks into a dormant one. Uses the rates of the last `update_lod`.
+*/
+void DungeonLevel::regroup_enemies() {
+    size_t side = std::max<size_t>(region_size, 1);
+    size_t regions = std::max<size_t>(
+        ((tiles.row_count() + side - 1) / side) * ((tiles.column_count() + side - 1) / side), 1
+    );
+    region_lods.resize(regions, 0);
+    auto is_dormant = [&](size_t r) { return region_lods[r] == LevelOfDetail::dormant_lod; };
+
+    // the dormant enemies keep their regions, unless the level was changed under them
+    dormant_count = std::min(dormant_count, enemies.size());
+    bool wakes_up =
+        dormant_offsets.size() != regions + 1 || dormant_offsets.back() != dormant_count;
+    for (size_t r = 0; !wakes_up && r < regions; ++r) {
+        wakes_up = dormant_offsets[r] != dormant_offsets[r + 1] && !is_dormant(r);
+    }
+
+    size_t first = wakes_up ? 0 : dormant_count;
+    enemy_regions.resize(enemies.size());
+    Game::get().jobs.parallel_for(enemies.size() - first, bodies_per_job, [&](size_t k) {
+        enemy_regions[first + k] = region_of(enemies[first + k].position());
+    });
+
+    region_offsets.assign(regions + 1, 0);
+    region_offsets[0] = first;
+    bool falls_asleep = false;
+    bool is_grouped = true;
+    for (size_t i = first; i < enemies.size(); ++i) {
+        ++region_offsets[enemy_regions[i] + 1];
+        falls_asleep = falls_asleep || is_dormant(enemy_regions[i]);
+        if (i > first && enemy_regions[i] < enemy_regions[i - 1]) is_grouped = false;
+    }
+
+    if (!wakes_up && !falls_asleep) {
+        for (size_t r = 1; r < region_offsets.size(); ++r) {
+            region_offsets[r] += region_offsets[r - 1];
+        }
+        if (!is_grouped) {
+            // a stable counting sort, so the order inside of a region stays the same,
+            // only the enemies that end up at another index are moved
+            std::vector<std::uint32_t> next(region_offsets.begin(), region_offsets.end() - 1);
+            regroup_sources.resize(enemies.size() - first);
+            for (size_t i = first; i < enemies.size(); ++i) {
+                regroup_sources[next[enemy_regions[i]]++ - first] = i;
+            }
+            enemies.reorder(regroup_sources, first);
+        }
+    } else {
+        // the dormant enemies go first, the sort is the same otherwise
+        for (size_t r = 0; first > 0 && r < regions; ++r) {
+            for (size_t i = dormant_offsets[r]; i < dormant_offsets[r + 1]; ++i) {
+                enemy_regions[i] = r;
+            }
+        }
+        dormant_offsets.assign(regions + 1, 0);
+        region_offsets.assign(regions + 1, 0);
+        for (size_t i = 0; i < enemies.size(); ++i) {
+            size_t r = enemy_regions[i];
+            ++(is_dormant(r) ? dormant_offsets : region_offsets)[r + 1];
+        }
+        for (size_t r = 1; r < dormant_offsets.size(); ++r) {
+            dormant_offsets[r] += dormant_offsets[r - 1];
+        }
+        dormant_count = dormant_offsets.back();
+        region_offsets[0] = dormant_count;
+        for (size_t r = 1; r < region_offsets.size(); ++r) {
+            region_offsets[r] += region_offsets[r - 1];
+        }
+
+        std::vector<std::uint32_t> next_dormant(dormant_offsets.begin(), dormant_offsets.end() - 1);
+        std::vector<std::uint32_t> next(region_offsets.begin(), region_offsets.end() - 1);
+        regroup_sources.resize(enemies.size());
+        for (size_t i = 0; i < enemies.size(); ++i) {
+            size_t r = enemy_regions[i];
+            regroup_sources[is_dormant(r) ? next_dormant[r]++ : next[r]++] = i;
+        }
+        enemies.reorder(regroup_sources);
+    }
+
+    active_lods.resize(enemies.size() - dormant_count);
+    for (size_t r = 0; r < regions; ++r) {
+        for (size_t i = region_offsets[r]; i < region_offsets[r + 1]; ++i) {
+            active_lods[i - dormant_count] = region_lods[r];
+        }
+    }
+}
+
+std::uint8_t LevelOfDetail::lod_of(float distance) const {
+    if (distance < half_rate) return 0;
+    if (distance < quarter_rate) return 1;
+    if (distance < eighth_rate) return 2;
+    if (distance < dormant) return 3;
+    return dormant_lod;
+}
+
+/*!
+Chooses the rate of every region by its distance to the player, then `regroup_enemies`
+puts the enemies of the dormant regions aside. Only touches the regions, not the enemies.
+*/
+void DungeonLevel::update_lod() {
+    Game &game = Game::get();
+    size_t side = std::max<size_t>(region_size, 1);
+    size_t region_columns = std::max<size_t>((tiles.column_count() + side - 1) / side, 1);
+    size_t regions = std::max<size_t>(
+        ((tiles.row_count() + side - 1) / side) * ((tiles.column_count() + side - 1) / side), 1
+    );
+
+    float factor = tile_coords_to_world_coords_factor();
+    sf::Vector2f player = game.dungeon.player.position() / factor;
+    boost::optional<sf::FloatRect> view;
+    if (!game.is_headless) {
+        sf::FloatRect rect = game.game_view.get_display_rect();
+        view = sf::FloatRect(rect.getPosition() / factor, rect.getSize() / factor);
+    }
+
+    region_lods.resize(regions);
+    for (size_t r = 0; r < regions; ++r) {
+        sf::Vector2f corner((float)(r / region_columns * side), (float)(r % region_columns * side));
+        sf::FloatRect area(corner, sf::Vector2f((float)side, (float)side));
+
+        // the distance to the closest point of the region, zero from the inside
+        sf::Vector2f outside = max(corner - player, player - corner - area.getSize());
+        float distance = length(max(outside, sf::Vector2f(0, 0)));
+        region_lods[r] = view && view->intersects(area) ? 0 : lod.lod_of(distance);
+    }
+}
+
+void DungeonLevel::update(float delta_time) {
+    behaviours.begin_frame(delta_time);
+    // the enemies are only removed and reordered here, so the groups stay valid
+    // for the rest of the frame and its fixed steps
     delete_dead_actors();
+    update_lod();
+    regroup_enemies();
+    publish_world_state();
+    update_flow_field();
+    update_perception();
+    damage_commands.prepare(Game::get().jobs.thread_count());
+    update_enemies(delta_time);
+    update_paths();  // found while the player is updated
+
+    Game::get().dungeon.player.update(delta_time);
+    damage_commands.apply();
+
+    merge_laying_items();
     delete_picked_up_items();
 }
 
-void DungeonLevel::update_enemies_in_thread(float delta_time, size_t id) {
-    size_t start = id * enemies.size() / thread_count;
-    size_t end = (id + 1) * enemies.size() / thread_count;
+void DungeonLevel::update_enemies(float delta_time) {
+    Game &game = Game::get();
+    ++lod_frame;
 
-    for (size_t i = start; i < end; ++i) {
-        enemies[i].update(delta_time);
-    }
+    // the far enemies skip frames, each one by its own phase, so the enemies next to each other
+    // skip different frames and keep their phase when they are moved around
+    game.enemy_update_tuner.parallel_for_groups(game.jobs, region_offsets, [&](size_t i) {
+        Enemy &enemy = enemies[i];
+        enemy.lod_delta_time += delta_time;
+        size_t period = (size_t)1 << active_lods[i - dormant_count];
+        if ((lod_frame + enemy.seed) % period != 0) return;
+
+        enemy.update(enemy.lod_delta_time);
+        enemy.lod_delta_time = 0.0f;
+    });
 }
 
-void DungeonLevel::fixed_update(float delta_time) {
-    for (auto &enemy : enemies) {
-        enemy.fixed_update(delta_time);
+void DungeonLevel::publish_world_state() {
+    WorldSnapshot &snapshot = world_state.write();
+    size_t first = std::min(dormant_count, enemies.size());
+    snapshot.first_enemy = first;
+    snapshot.enemies.resize(enemies.size() - first);
+    Game::get().jobs.parallel_for(snapshot.enemies.size(), bodies_per_job, [&](size_t k) {
+        snapshot.enemies[k] = ActorState::of(enemies[first + k]);
+    });
+    snapshot.player = ActorState::of(Game::get().dungeon.player);
+    world_state.publish();
+    update_spatial_index();
+}
+
+void SpatialQuery::clear() {
+    enemies.clear();
+    laying_items.clear();
+}
+
+/*!
+The enemies are indexed at the positions of the published snapshot, so the queries agree
+with what the weapons see. The items are indexed as they lay at the time of the call.
+*/
+void DungeonLevel::update_spatial_index() {
+    float factor = tile_coords_to_world_coords_factor();
+    const WorldSnapshot &snapshot = world_state.read();
+
+    enemy_index.resize(tiles.row_count(), tiles.column_count(), factor);
+    enemy_index.update(snapshot.enemies.size(), [&](size_t i) {
+        return snapshot.enemies[i].position;
+    });
+    item_index.resize(tiles.row_count(), tiles.column_count(), factor);
+    item_index.update(laying_items.size(), [&](size_t i) { return laying_items[i].position(); });
+}
+
+/*!
+Finds the enemies and the items whose centers are inside the rectangle.
+*/
+void DungeonLevel::query_rect(const sf::FloatRect &rect, SpatialQuery &result) const {
+    result.clear();
+    const WorldSnapshot &snapshot = world_state.read();
+
+    enemy_index.for_each_in_rect(rect, [&](size_t k) {
+        if (rect.contains(snapshot.enemies[k].position)) {
+            result.enemies.push_back(snapshot.first_enemy + k);
+        }
+    });
+    item_index.for_each_in_rect(rect, [&](size_t i) {
+        if (i < laying_items.size() && rect.contains(laying_items[i].position())) {
+            result.laying_items.push_back(i);
+        }
+    });
+    std::sort(result.enemies.begin(), result.enemies.end());
+    std::sort(result.laying_items.begin(), result.laying_items.end());
+}
+
+/*!
+Finds the enemies and the items whose centers are at most `radius` away from `center`.
+*/
+void DungeonLevel::query_radius(sf::Vector2f center, float radius, SpatialQuery &result) const {
+    result.clear();
+    const WorldSnapshot &snapshot = world_state.read();
+    float radius_squared = radius * radius;
+
+    if (!std::isfinite(radius)) {
+        for (size_t k = 0; k < snapshot.enemies.size(); ++k) {
+            result.enemies.push_back(snapshot.first_enemy + k);
+        }
+        for (size_t i = 0; i < std::min(item_index.size(), laying_items.size()); ++i) {
+            result.laying_items.push_back(i);
+        }
+        return;
     }
-    Game::get().dungeon.player.fixed_update(delta_time);
 
-    handle_collitions();
+    sf::FloatRect rect(center.x - radius, center.y - radius, 2 * radius, 2 * radius);
+    enemy_index.for_each_in_rect(rect, [&](size_t k) {
+        if (length_squared(snapshot.enemies[k].position - center) <= radius_squared) {
+            result.enemies.push_back(snapshot.first_enemy + k);
+        }
+    });
+    item_index.for_each_in_rect(rect, [&](size_t i) {
+        if (i < laying_items.size() &&
+            length_squared(laying_items[i].position() - center) <= radius_squared)
+        {
+            result.laying_items.push_back(i);
+        }
+    });
+    std::sort(result.enemies.begin(), result.enemies.end());
+    std::sort(result.laying_items.begin(), result.laying_items.end());
 }
 
-void DungeonLevel::delete_dead_actors() {
-    size_t c = 0;
-    for (size_t i = 0; i < enemies.size(); ++i) {
-        if (!enemies[c].ready_to_be_deleted()) {
-            ++c;
-        } else if (!enemies[i].ready_to_be_deleted()) {
-            std::swap(enemies[c], enemies[i]);
-            ++c;
+void DungeonLevel::fixed_update(float delta_time) {
+    publish_world_state();
+
+    // enemies only read the snapshot of the player, so the player is moved after them;
+    // the steering is cheap, so all the enemies that are not dormant steer on every step
+    Game &game = Game::get();
+    game.enemy_fixed_update_tuner.parallel_for_groups(game.jobs, region_offsets, [&](size_t i) {
+        Enemy &enemy = enemies[i];
+        if (enemy.alive) enemy.handle_movement(delta_time);
+    });
+    Player &player = game.dungeon.player;
+    if (player.alive) player.handle_movement(delta_time);
+
+    // The rest only needs the data of the bodies, so it goes over the stores that own it.
+    // The player takes the row after the enemies for the time of the passes,
+    // so the awake enemies and the player are one range of the store.
+    // the friction is applied in the same pass as the integration, on every step;
+    // the laying items are integrated here as well, so thrown items now slide and slow down
+    BodyStore &bodies = enemies.get_store();
+    size_t first = std::min(dormant_count, enemies.size());
+    size_t end = enemies.size() + 1;
+    bodies.resize(end);
+    player.bind(&bodies, end - 1);
+    game.jobs.parallel_for_chunks(end - first, bodies_per_job, [&](size_t begin, size_t stop) {
+        bodies.step(first + begin, first + stop, delta_time);
+    });
+    BodyStore &items = laying_items.get_store();
+    game.jobs.parallel_for_chunks(items.size(), bodies_per_job, [&](size_t begin, size_t stop) {
+        items.step(begin, stop, delta_time);
+    });
+    handle_collitions(first, end);
+    player.unbind();
+    bodies.resize(end - 1);
+}
+
+void DamageCommandBuffer::prepare(size_t thread_count) {
+    if (per_thread.size() < thread_count) per_thread.resize(thread_count);
+}
+
+void DamageCommandBuffer::push(const DamageCommand &command) {
+    size_t index = Game::get().jobs.current_thread_index();
+    assert(index < per_thread.size() && "DamageCommandBuffer::prepare was not called");
+    per_thread[index].commands.push_back(command);
+}
+
+void DamageCommandBuffer::apply() {
+    merged.clear();
+    for (auto &it : per_thread) {
+        merged.insert(merged.end(), it.commands.begin(), it.commands.end());
+        it.commands.clear();
+    }
+
+    // every source is updated by one thread, so its own commands are already in order
+    std::stable_sort(
+        merged.begin(), merged.end(),
+        [](const DamageCommand &a, const DamageCommand &b) {
+            std::less<const Actor *> less;
+            if (a.target != b.target) return less(a.target, b.target);
+            return less(a.source, b.source);
         }
+    );
+
+    for (auto &command : merged) {
+        command.target->apply_force(command.force);
+        command.target->take_damage(command.damage, *command.source);
     }
+    merged.clear();
+}
 
-    for (size_t i = c; i < enemies.size(); ++i) {
-        enemies[i].on_deletion();
+void DamageCommandBuffer::clear() {
+    for (auto &it : per_thread) {
+        it.commands.clear();
     }
+    merged.clear();
+}
 
-    enemies.erase(std::next(enemies.begin(), c), enemies.end());
+void DungeonLevel::delete_dead_actors() {
+    // every chunk drops its loot into its own batch, so the order does not depend on threads;
+    // the dormant enemies are not looked at, nothing can kill them
+    dormant_count = std::min(dormant_count, enemies.size());
+    size_t chunks = compaction_chunk_count(enemies.size() - dormant_count, bodies_per_job);
+    drops.resize(std::max(drops.size(), chunks));
+    parallel_compact(
+        Game::get().jobs, enemies, bodies_per_job,
+        [](const Enemy &enemy) { return enemy.ready_to_be_deleted(); },
+        [this](Enemy &enemy, size_t chunk) { enemy.on_deletion(drops[chunk]); }, dormant_count
+    );
+    add_laying_items(drops);
 }
 
 void DungeonLevel::delete_picked_up_items() {
-    size_t c = 0;
-    for (size_t i = 0; i < laying_items.size(); ++i) {
-        if (!laying_items[c].picked_up) {
-            ++c;
-        } else if (!laying_items[i].picked_up) {
-            std::swap(laying_items[c], laying_items[i]);
-            ++c;
+    parallel_compact(
+        Game::get().jobs, laying_items, bodies_per_job,
+        [](const LayingItem &laying_item) { return laying_item.picked_up; },
+        [](LayingItem &, size_t) {}
+    );
+}
+
+/*!
+Ticks a level the player is not on, once in `tick_time` with one step for the whole time.
+Only the enemies move, they walk back home and hit the walls, and nothing fights.
+A tick stops after `budget_us` and is continued on the next call.
+Returns true when a tick was finished.
+*/
+bool DungeonLevel::background_update(float delta_time, float tick_time, float budget_us) {
+    background_time += delta_time;
+    if (background_cursor == 0) {
+        if (background_time < tick_time) return false;
+        background_delta_time = std::min(background_time, max_background_step);
+        background_time = 0.0f;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto budget = std::chrono::duration<float, std::micro>(budget_us);
+    while (background_cursor < enemies.size()) {
+        size_t end = std::min(enemies.size(), background_cursor + bodies_per_job);
+        for (size_t i = background_cursor; i < end; ++i) {
+            enemies[i].background_update(background_delta_time);
         }
+        background_cursor = end;
+        if (std::chrono::steady_clock::now() - start > budget) break;
     }
-    laying_items.erase(std::next(laying_items.begin(), c), laying_items.end());
+    if (background_cursor < enemies.size()) return false;
+    background_cursor = 0;
+
+    handle_rigid_body_level_collitions(enemies.get_store(), 0, enemies.size());
+    return true;
 }
 
-void DungeonLevel::handle_collitions() {
-    {
-        std::vector<RigidBody *> bodies(enemies.size() + 1);
-        for (size_t i = 0; i < enemies.size(); ++i) {
-            bodies[i] = &enemies[i];
+/*!
+Moves the items into the stacks of the same class that lay close enough,
+the older stacks are filled first. Then drops the oldest generated items above
+`max_laying_items`, the thrown items and the loot stay. The emptied items are marked
+as picked up, so `delete_picked_up_items` removes them.
+Uses `item_index` of the last `update_spatial_index`, the items added after it are merged
+on the next call.
+*/
+void DungeonLevel::merge_laying_items() {
+    float factor = tile_coords_to_world_coords_factor();
+    float radius = laying_item_merge_radius * factor;
+    size_t reach = (size_t)std::ceil(laying_item_merge_radius);
+    size_t indexed = std::min(item_index.size(), laying_items.size());
+
+    if (laying_item_merge_radius > 0.0f && indexed > 1) {
+        std::vector<size_t> neighbours;
+        for (size_t i = 0; i < indexed; ++i) {
+            LayingItem &stack = laying_items[i];
+            if (stack.picked_up || !stack.item) continue;
+            size_t max_stack_size = stack.item->get_class().max_stack_size;
+            if (stack.count >= max_stack_size) continue;
+
+            neighbours.clear();
+            item_index.for_each_near(stack.position(), reach, [&](size_t j) {
+                if (j > i && j < indexed) neighbours.push_back(j);
+            });
+            std::sort(neighbours.begin(), neighbours.end());
+
+            for (size_t j : neighbours) {
+                LayingItem &other = laying_items[j];
+                if (other.picked_up || !other.item) continue;
+                if (other.item->item_class_index != stack.item->item_class_index) continue;
+                if (length_squared(other.position() - stack.position()) > radius * radius) continue;
+
+                size_t moved = std::min(other.count, max_stack_size - stack.count);
+                stack.count += moved;
+                stack.generated = stack.generated && other.generated;
+                other.count -= moved;
+                if (other.count == 0) other.picked_up = true;
+                if (stack.count >= max_stack_size) break;
+            }
         }
-        bodies[enemies.size()] = &Game::get().dungeon.player;
+    }
 
-        handle_rigid_body_level_collitions(bodies);
-        handle_actor_actor_collitions(bodies);
-        handle_rigid_body_level_collitions(bodies);
+    size_t left = 0;
+    for (auto &it : laying_items) {
+        left += !it.picked_up;
     }
-    {
-        std::vector<RigidBody *> item_bodies(laying_items.size());
-        for (size_t i = 0; i < laying_items.size(); ++i) {
-            item_bodies[i] = &laying_items[i];
-        }
-        handle_rigid_body_level_collitions(item_bodies);
+    for (size_t i = 0; i < laying_items.size() && left > max_laying_items; ++i) {
+        if (laying_items[i].picked_up || !laying_items[i].generated) continue;
+        laying_items[i].picked_up = true;
+        --left;
+        ++dropped_laying_items;
     }
 }
 
-void DungeonLevel::handle_actor_actor_collitions(std::vector<RigidBody *> &bodies) {
-    // optimisation: space partitioning algorithm to get rid of O(n^2)
-
-    std::vector<sf::FloatRect> aabbs(bodies.size());
-    for (size_t i = 0; i < bodies.size(); ++i) {
-        aabbs[i] = bodies[i]->get_axes_aligned_bounding_box();
+/*!
+Moves the items of all the batches to the level and leaves the batches empty.
+*/
+void DungeonLevel::add_laying_items(std::vector<std::vector<LayingItem>> &batches) {
+    size_t count = laying_items.size();
+    for (const auto &batch : batches) {
+        count += batch.size();
     }
+    laying_items.reserve(count);
+    for (auto &batch : batches) {
+        for (LayingItem &item : batch) laying_items.push_back(std::move(item));
+        batch.clear();
+    }
+}
 
-    std::vector<sf::Vector2f> directions(bodies.size());
-
-    for (size_t i = 0; i < bodies.size(); ++i) {
-        for (size_t j = i + 1; j < bodies.size(); ++j) {
-            sf::FloatRect intersection;
-            if (!aabbs[i].intersects(aabbs[j], intersection)) continue;
+/*!
+Resolves the collitions of the bodies [first, end) of the store of the enemies,
+and of all the laying items.
+*/
+void DungeonLevel::handle_collitions(size_t first, size_t end) {
+    BodyStore &bodies = enemies.get_store();
+    handle_rigid_body_level_collitions(bodies, first, end);
+    handle_actor_actor_collitions(bodies, first, end);
+    handle_rigid_body_level_collitions(bodies, first, end);
 
-            sf::Vector2f diff = ::center(aabbs[i]) - ::center(aabbs[j]);
-            sf::Vector2f correction = intersection.getSize() * 2 / 3;
+    BodyStore &items = laying_items.get_store();
+    handle_rigid_body_level_collitions(items, 0, items.size());
+}
 
-            // make sure the direction is correct
-            if (diff.x < 0) {
-                correction.x = -correction.x;
-            }
-            if (diff.y < 0) {
-                correction.y = -correction.y;
-            }
+sf::Vector2f actor_actor_correction(const sf::FloatRect &a, const sf::FloatRect &b) {
+    sf::FloatRect intersection;
+    if (!a.intersects(b, intersection)) return sf::Vector2f(0, 0);
 
-            // choose the axis to correct (minimal one)
-            if (abs(correction.x) < abs(correction.y)) {
-                correction.y = 0;
-            } else {
-                correction.x = 0;
-            }
+    sf::Vector2f diff = ::center(a) - ::center(b);
+    sf::Vector2f correction = intersection.getSize() * 2 / 3;
 
-            directions[i] += correction;
-            directions[j] -= correction;
-        }
+    // make sure the direction is correct
+    if (diff.x < 0) {
+        correction.x = -correction.x;
+    }
+    if (diff.y < 0) {
+        correction.y = -correction.y;
     }
 
-    for (size_t i = 0; i < bodies.size(); ++i) {
-        if (bodies[i]->pushable) bodies[i]->position += directions[i];
+    // choose the axis to correct (minimal one)
+    if (abs(correction.x) < abs(correction.y)) {
+        correction.y = 0;
+    } else {
+        correction.x = 0;
     }
+
+    return correction;
 }
 
-void DungeonLevel::handle_rigid_body_level_collitions(std::vector<RigidBody *> &bodies) {
-    std::vector<sf::FloatRect> aabbs(bodies.size());
-    for (size_t i = 0; i < bodies.size(); ++i) {
-        aabbs[i] = bodies[i]->get_axes_aligned_bounding_box();
+/*!
+Pushes apart the bodies [first, end) of the store.
+*/
+void DungeonLevel::handle_actor_actor_collitions(BodyStore &bodies, size_t first, size_t end) {
+    size_t count = end - first;
+    std::vector<sf::FloatRect> &aabbs = actor_boxes;
+    aabbs.resize(count);
+    float max_size = 0.0f;
+    for (size_t i = 0; i < count; ++i) {
+        aabbs[i] = bodies.get_axes_aligned_bounding_box(first + i, Game::world_size);
+        max_size = std::max({max_size, aabbs[i].width, aabbs[i].height});
+    }
+
+    float factor = tile_coords_to_world_coords_factor();
+    actor_grid.resize(tiles.row_count(), tiles.column_count(), factor);
+    actor_grid.update(count, [&](size_t i) { return bodies.positions[first + i]; });
+
+    // two boxes intersect only if their centers are closer than max_size on both axes
+    size_t reach = (size_t)std::ceil(max_size / factor);
+
+    // Every body sums up its own corrections, so the bodies can be processed in parallel.
+    // Neighbours are visited in the increasing order of their indices, and a pair (i, j)
+    // with i < j is always evaluated as (i, j), that gives exactly the same sums
+    // as the all-pairs loop did.
+    std::vector<sf::Vector2f> &directions = actor_corrections;
+    directions.resize(count);
+    Game::get().jobs.parallel_for(count, bodies_per_job, [&](size_t i) {
+        static thread_local std::vector<size_t> neighbours;
+        neighbours.clear();
+        actor_grid.for_each_near(bodies.positions[first + i], reach, [&](size_t j) {
+            if (i != j) neighbours.push_back(j);
+        });
+        std::sort(neighbours.begin(), neighbours.end());
+
+        sf::Vector2f direction(0, 0);
+        for (size_t j : neighbours) {
+            if (j < i) {
+                direction -= actor_actor_correction(aabbs[j], aabbs[i]);
+            } else {
+                direction += actor_actor_correction(aabbs[i], aabbs[j]);
+            }
+        }
+        directions[i] = direction;
+    });
+
+    for (size_t i = 0; i < count; ++i) {
+        if (bodies.pushable[first + i]) bodies.positions[first + i] += directions[i];
     }
+}
 
+/*!
+Keeps the bodies [first, end) of the store inside of the level.
+*/
+void DungeonLevel::handle_rigid_body_level_collitions(
+    BodyStore &bodies, size_t first, size_t end
+) {
     float right_wall = tiles.row_count() * tile_coords_to_world_coords_factor();
     float down_wall = tiles.column_count() * tile_coords_to_world_coords_factor();
 
-    for (size_t i = 0; i < bodies.size(); ++i) {
-        if (aabbs[i].left < 0) {
-            bodies[i]->position.x += 0 - aabbs[i].left;
-            bodies[i]->velocity.x -= bodies[i]->velocity.x * rebounce_factor;
+    // every body is only checked against the walls, so they are independent
+    Game::get().jobs.parallel_for(end - first, bodies_per_job, [&](size_t k) {
+        size_t i = first + k;
+        sf::Vector2f &position = bodies.positions[i];
+        sf::Vector2f &velocity = bodies.velocities[i];
+        sf::FloatRect aabb = bodies.get_axes_aligned_bounding_box(i, Game::world_size);
+
+        if (aabb.left < 0) {
+            position.x += 0 - aabb.left;
+            velocity.x -= velocity.x * rebounce_factor;
         }
-        if (aabbs[i].top < 0) {
-            bodies[i]->position.y += 0 - aabbs[i].top;
-            bodies[i]->velocity.y -= bodies[i]->velocity.y * rebounce_factor;
+        if (aabb.top < 0) {
+            position.y += 0 - aabb.top;
+            velocity.y -= velocity.y * rebounce_factor;
         }
 
-        float right = aabbs[i].left + aabbs[i].width;
+        float right = aabb.left + aabb.width;
         if (right > right_wall) {
-            bodies[i]->position.x -= right - right_wall;
-            bodies[i]->velocity.x -= bodies[i]->velocity.x * rebounce_factor;
+            position.x -= right - right_wall;
+            velocity.x -= velocity.x * rebounce_factor;
         }
-        float down = aabbs[i].top + aabbs[i].height;
+        float down = aabb.top + aabb.height;
         if (down > down_wall) {
-            bodies[i]->position.y -= down - down_wall;
-            bodies[i]->velocity.y -= bodies[i]->velocity.y * rebounce_factor;
+            position.y -= down - down_wall;
+            velocity.y -= velocity.y * rebounce_factor;
         }
-    }
+    });
 }
 
 bool DungeonLevelView::init() {
-    if (!flor_tile_texture.loadFromFile(path_to_resources + flor_tile_name)) return false;
-    if (!open_dor_tile_texture.loadFromFile(path_to_resources + open_dor_tile_name)) return false;
-    if (!closed_dor_tile_texture.loadFromFile(path_to_resources + closed_dor_tile_name))
-        return false;
-    if (!barrier_tile_texture.loadFromFile(path_to_resources + barrier_tile_name)) return false;
-    if (!chest_texture.loadFromFile(path_to_resources + chest_name)) return false;
-    if (!up_laddor_tile_texture.loadFromFile(path_to_resources + up_laddor_tile_name)) return false;
-    if (!down_laddor_tile_texture.loadFromFile(path_to_resources + down_laddor_tile_name))
-        return false;
-
-    setup_sprite(flor_tile_texture, flor_tile_sprite);
-    flor_tile_sprite.setOrigin({0, 0});
-
-    setup_sprite(open_dor_tile_texture, open_dor_tile_sprite);
-    open_dor_tile_sprite.setOrigin({0, 0});
-
-    setup_sprite(closed_dor_tile_texture, closed_dor_tile_sprite);
-    closed_dor_tile_sprite.setOrigin({0, 0});
-
-    setup_sprite(up_laddor_tile_texture, up_laddor_tile_sprite);
-    up_laddor_tile_sprite.setOrigin({0, 0});
-
-    setup_sprite(down_laddor_tile_texture, down_laddor_tile_sprite);
-    down_laddor_tile_sprite.setOrigin({0, 0});
-
-    setup_sprite(barrier_tile_texture, barrier_tile_sprite);
-    barrier_tile_sprite.setOrigin({0, 0});
+    auto load_tile = [](const char *name, sf::Texture &texture, sf::Sprite &sprite) {
+        load_texture_async(name, texture, [&sprite](sf::Texture &texture) {
+            setup_sprite(texture, sprite);
+            sprite.setOrigin({0, 0});
+        });
+    };
 
-    setup_sprite(chest_texture, chest_sprite);
-    chest_sprite.setOrigin({0, 0});
+    load_tile(flor_tile_name, flor_tile_texture, flor_tile_sprite);
+    load_tile(open_dor_tile_name, open_dor_tile_texture, open_dor_tile_sprite);
+    load_tile(closed_dor_tile_name, closed_dor_tile_texture, closed_dor_tile_sprite);
+    load_tile(up_laddor_tile_name, up_laddor_tile_texture, up_laddor_tile_sprite);
+    load_tile(down_laddor_tile_name, down_laddor_tile_texture, down_laddor_tile_sprite);
+    load_tile(barrier_tile_name, barrier_tile_texture, barrier_tile_sprite);
+    load_tile(chest_name, chest_texture, chest_sprite);
 
     return true;
 }
 
-void DungeonLevelView::draw(const DungeonLevel &level) {
+void DungeonLevelView::extract(const DungeonLevel &level, RenderSnapshot &frame) const {
     sf::FloatRect view_rect = Game::get().game_view.get_display_rect();
 
     sf::Vector2f start_of_view_f =
@@ -1137,35 +1917,55 @@ void DungeonLevelView::draw(const DungeonLevel &level) {
     sf::Vector2f start_of_view(start_of_view_f);
     sf::Vector2f end_of_view(end_of_view_f);
 
+    frame.tile_factor = level.tile_coords_to_world_coords_factor();
+    frame.chest_size_factor = level.chest_size_factor;
+
+    frame.tiles.clear();
     for (size_t i = start_of_view.x; i < end_of_view.x; ++i) {
         auto &row = level.tiles[i];
         for (size_t j = start_of_view.y; j < end_of_view.y; ++j) {
-            draw_tile(
-                row[j], sf::Vector2f(i, j), level.tile_coords_to_world_coords_factor(),
-                level.chest_size_factor
-            );
+            frame.tiles.push_back(TileSprite{row[j].kind, row[j].building != nullptr, i, j});
         }
     }
 
+    frame.items.clear();
     for (const LayingItem &laying_item : level.laying_items) {
         if (laying_item.picked_up) continue;
-        actors_view.items_view.draw(*(laying_item.item), laying_item.position);
+        frame.items.push_back(
+            ItemSprite{laying_item.item->item_class_index, laying_item.position()}
+        );
+    }
+
+    // the dormant enemies are never in the view
+    frame.actors.clear();
+    size_t first = std::min(level.dormant_count, level.enemies.size());
+    for (size_t i = first; i < level.enemies.size(); ++i) {
+        frame.actors.push_back(actors_view.extract(level.enemies[i]));
+    }
+    frame.actors.push_back(actors_view.extract(Game::get().dungeon.player));
+}
+
+void DungeonLevelView::draw(const RenderSnapshot &frame) {
+    for (const TileSprite &tile : frame.tiles) {
+        draw_tile(tile, frame.tile_factor, frame.chest_size_factor);
+    }
+
+    for (const ItemSprite &item : frame.items) {
+        actors_view.items_view.draw(item.item_class_index, item.position);
     }
 
-    for (const auto &emeny : level.enemies) {
-        actors_view.draw(emeny);
+    for (const ActorSprite &actor : frame.actors) {
+        actors_view.draw(actor);
     }
-    actors_view.draw(Game::get().dungeon.player);
 
-    for (const auto &emeny : level.enemies) {
-        actors_view.draw_ui(emeny);
+    for (const ActorSprite &actor : frame.actors) {
+        actors_view.draw_ui(actor);
     }
-    actors_view.draw_ui(Game::get().dungeon.player);
 }
 
-void DungeonLevelView::draw_tile(
-    const Tile &tile, sf::Vector2f position, float factor, float chest_size_factor
-) {
+void DungeonLevelView::draw_tile(const TileSprite &tile, float factor, float chest_size_factor) {
+    sf::Vector2f position(tile.x, tile.y);
+
     sf::Sprite sprite;
     if (tile.kind == Tile::Barrier) {
         sprite = barrier_tile_sprite;
@@ -1187,7 +1987,7 @@ void DungeonLevelView::draw_tile(
     Game::get().game_view.draw_culled(sprite);
     sprite.setScale(saved);
 
-    if (tile.building) {
+    if (tile.has_chest) {
         saved = chest_sprite.getScale();
         chest_sprite.setScale(saved * factor * chest_size_factor);
         chest_sprite.setPosition(position * factor);
@@ -1206,36 +2006,47 @@ float symmetric_linear_easing(float t, float p) {
     }
 }
 
+sf::Color SpriteColorAnimator::color_at(sf::Time elapsed_time) const {
+    if (elapsed_time > duration) return inactive_color;
+    float t = symmetric_linear_easing(elapsed_time.asSeconds() / duration.asSeconds(), 0.3f);
+    return inactive_color * (1 - t) + active_color * t;
+}
+
 void SpriteColorAnimator::update(sf::Time elapsed_time, sf::Sprite &sprite) {
-    if (elapsed_time > duration) {
-        sprite.setColor(inactive_color);
-    } else {
-        float t = symmetric_linear_easing(elapsed_time.asSeconds() / duration.asSeconds(), 0.3f);
-        sprite.setColor(inactive_color * (1 - t) + active_color * t);
+    sprite.setColor(color_at(elapsed_time));
+}
+
+ActorSprite ActorsView::extract(const Actor &actor) const {
+    ActorSprite result;
+    result.actor_class_index = actor.actor_class_index;
+    result.position = actor.position();
+    result.size = actor.size();
+    result.color = taked_damage_animator.color_at(actor.since_last_taken_damage.getElapsedTime());
+    if (!actor.alive) {
+        result.color = result.color * death_color_multiplier;
     }
+    result.has_weapon = (bool)actor.equipment.weapon();
+    result.weapon_class_index =
+        result.has_weapon ? actor.equipment.weapon().item->item_class_index : 0;
+    result.health_ratio = std::max(0.0f, actor.health) / actor.characteristics.max_health;
+    return result;
 }
 
-void ActorsView::draw(const Actor &actor) {
-    sf::Sprite &sprite = actor.get_class().sprite;
+void ActorsView::draw(const ActorSprite &actor) {
+    sf::Sprite &sprite = Game::get().actor_classes[actor.actor_class_index].sprite;
     sf::Vector2f saved = sprite.getScale();
     sprite.setScale(saved * actor.size / Game::world_size);
     sprite.setPosition(actor.position);
-    taked_damage_animator.update(actor.since_last_taken_damage.getElapsedTime(), sprite);
-    if (!actor.alive) {
-        sprite.setColor(sprite.getColor() * death_color_multiplier);
-    }
+    sprite.setColor(actor.color);
     Game::get().game_view.draw_culled(sprite);
     sprite.setScale(saved);
 
-    if (actor.equipment.weapon()) items_view.draw(*(actor.equipment.weapon().item), actor.position);
+    if (actor.has_weapon) items_view.draw(actor.weapon_class_index, actor.position);
 }
 
-void ActorsView::draw_ui(const Actor &actor) {
+void ActorsView::draw_ui(const ActorSprite &actor) {
     float bar_width = actor.size / Game::world_size * 1.2f;
-    health_bar.draw(
-        actor.position - bar_width / 2.0f, bar_width,
-        std::max(0.0f, actor.health) / actor.characteristics.max_health
-    );
+    health_bar.draw(actor.position - bar_width / 2.0f, bar_width, actor.health_ratio);
 }
 
 void ProgressBarView::draw(sf::Vector2f position, float bar_width, float ratio) {
@@ -1250,8 +2061,8 @@ void ProgressBarView::draw(sf::Vector2f position, float bar_width, float ratio)
     Game::get().game_view.draw_culled(cur_bar);
 }
 
-void ItemsView::draw(const Item &item, sf::Vector2f position) {
-    auto &cls = item.get_class();
+void ItemsView::draw(size_t item_class_index, sf::Vector2f position) {
+    auto &cls = Game::get().item_classes[item_class_index];
     sf::Sprite &sprite = cls.sprite;
     sf::Vector2f saved = sprite.getScale();
     sprite.setScale(saved * cls.size / Game::world_size);
@@ -1268,12 +2079,19 @@ void StackOfItemsView::init() {
     count_text.setOutlineThickness(3);
 }
 
+SlotSprite SlotSprite::of(const StackOfItems &stack) {
+    SlotSprite result;
+    result.count = stack.size;
+    if (stack.size != 0) result.item_class_index = stack.item->item_class_index;
+    return result;
+}
+
 void StackOfItemsView::draw(
-    const StackOfItems &stack, sf::Vector2f position, float size, bool selected
+    const SlotSprite &stack, sf::Vector2f position, float size, bool selected
 ) {
     sf::Sprite sprite;
-    if (stack.size != 0) {
-        auto &cls = stack.item->get_class();
+    if (stack.count != 0) {
+        auto &cls = Game::get().item_classes[stack.item_class_index];
         sprite = cls.sprite;
     }
 
@@ -1296,8 +2114,8 @@ void StackOfItemsView::draw(
 
     window.draw(sprite);
 
-    if (stack.size > 1) {
-        count_text.setString(std::to_string(stack.size));
+    if (stack.count > 1) {
+        count_text.setString(std::to_string(stack.count));
         center_text_origin(count_text);
         count_text.setPosition(
             position + sprite.getGlobalBounds().getSize() / 2 -
@@ -1314,6 +2132,11 @@ bool Dungeon::load_level(size_t index) {
     if (index < 0 || index >= all_levels.size()) {
         return false;
     }
+    wait_background_levels();
+    if (simulate_background_levels && current_level && current_level_index >= 0) {
+        // the level that is left keeps living instead of being thrown away
+        all_levels[current_level_index] = std::move(*current_level);
+    }
     current_level = all_levels[index];
     current_level_index = index;
     on_load_level(*current_level);
@@ -1322,7 +2145,7 @@ bool Dungeon::load_level(size_t index) {
 
 void Dungeon::on_load_level(DungeonLevel &level) {
     Game::get().player_template.deepcopy_to(player);
-    player.position = level.initial_player_position;
+    player.position() = level.initial_player_position;
 }
 
 void Dungeon::unload_current_level() {
@@ -1331,17 +2154,21 @@ void Dungeon::unload_current_level() {
 }
 
 bool ActorClass::init() {
-    if (!texture.loadFromFile(path_to_resources + texture_name)) return false;
-    setup_sprite(texture, sprite);
+    load_texture_async(texture_name, texture, [this](sf::Texture &texture) {
+        setup_sprite(texture, sprite);
+    });
     return true;
 }
 
 bool ItemClass::init() {
-    if (!texture.loadFromFile(path_to_resources + texture_name)) return false;
-    setup_sprite(texture, sprite);
+    load_texture_async(texture_name, texture, [this](sf::Texture &texture) {
+        setup_sprite(texture, sprite);
+    });
     return true;
 }
 
+DeepCopyCls(Chest) { inventory.deepcopy_to(other.inventory); }
+
 LockPickingResult Chest::simulate_picking(const Actor &source) {
     RangeOfLong range(0, 1 + 2 * level);
     if ((float)range.get_random() / source.characteristics.luck <= 1) {
@@ -1464,6 +2291,10 @@ void Actor::take_damage(float amount, Actor &source) {
     }
 }
 
+ActorState ActorState::of(const Actor &actor) {
+    return ActorState{actor.position(), actor.velocity(), actor.size(), actor.health, actor.alive};
+}
+
 ActorClass &Actor::get_class() const { return Game::get().actor_classes[actor_class_index]; }
 
 void Experience::gain(size_t amount) {
@@ -1486,34 +2317,59 @@ size_t Experience::needs_exp_for_level(size_t level) { return 4 * level * level
 void Experience::level_up() { level += 1; }
 
 DeepCopyCls(RigidBody) {
-    other.position = position;
-    other.pushable = pushable;
-    other.size = size;
-    other.mut = std::make_shared<std::mutex>();
+    other.position() = position();
+    other.pushable() = pushable();
+    other.size() = size();
+}
+
+void RigidBody::set_data(const BodyData &data) {
+    if (store) {
+        store->write(row, data);
+    } else {
+        this->data = data;
+    }
+}
+
+void RigidBody::bind(BodyStore *store, size_t row) {
+    store->write(row, get_data());
+    rebind(store, row);
+}
+
+void RigidBody::rebind(BodyStore *store, size_t row) {
+    this->store = store;
+    this->row = row;
+}
+
+void RigidBody::unbind() {
+    data = get_data();
+    store = nullptr;
+    row = 0;
 }
 
 bool RigidBody::is_moving(float epsilon) const {
+    sf::Vector2f velocity = this->velocity();
     return velocity.x > epsilon || velocity.y > epsilon;
 }
 
 void RigidBody::move(sf::Vector2f direction, float speed, float delta_time) {
-    position += normalized(direction) * speed * delta_time;
+    position() += normalized(direction) * speed * delta_time;
 }
 
-void RigidBody::apply_force(sf::Vector2f forece) { acceleration += forece / mass; }
+void RigidBody::apply_force(sf::Vector2f forece) { acceleration() += forece / mass(); }
 
-void RigidBody::apply_impulse(sf::Vector2f impulse) { velocity += impulse / mass; }
+void RigidBody::apply_impulse(sf::Vector2f impulse) { velocity() += impulse / mass(); }
 
-void RigidBody::apply_friction() { apply_force(-(velocity)*friction_coefficient * mass); }
+void RigidBody::apply_friction() { apply_force(-velocity() * friction_coefficient() * mass()); }
 
 void RigidBody::fixed_update(float delta_time) {
-    velocity += acceleration * delta_time;
-    position += velocity * delta_time;
-    acceleration = sf::Vector2f(0, 0);
+    velocity() += acceleration() * delta_time;
+    position() += velocity() * delta_time;
+    acceleration() = sf::Vector2f(0, 0);
 }
 
 sf::FloatRect RigidBody::get_axes_aligned_bounding_box() const {
-    float size = this->size / Game::world_size;
+    float size = this->size() / Game::world_size;
+    sf::Vector2f position = this->position();
     return sf::FloatRect(position.x - size / 2, position.y - size / 2, size, size);
 }
 
@@ -1528,16 +2384,8 @@ DeepCopyCls(Player) {
     inventory.deepcopy_to(other.inventory);
 }
 
-void Player::fixed_update(float delta_time) {
-    RigidBody::fixed_update(delta_time);
-
-    if (!alive) return;
-
-    handle_movement(delta_time);
-}
-
 void Player::update(float delta_time) {
-    if (!alive) return;
+    if (!alive || Game::get().is_headless) return;
 
     handle_equipment_use();
     handle_slot_selection();
@@ -1553,7 +2401,7 @@ void Player::handle_level_transition() {
     auto &level = Game::get().dungeon.current_level;
     if (!level) return;
 
-    auto coords = level->get_tile_coordinates(position);
+    auto coords = level->get_tile_coordinates(position());
     if (!coords) return;
 
     Tile &tile = level->tiles[coords->first][coords->second];
@@ -1573,6 +2421,7 @@ void Player::handle_level_transition() {
 }
 
 void Player::handle_movement(float delta_time) {
+    if (Game::get().is_headless) return;
     sf::Vector2f direction(0, 0);
 
     if (sf::Keyboard::isKeyPressed(sf::Keyboard::Up) || sf::Keyboard::isKeyPressed(sf::Keyboard::W))
@@ -1652,7 +2501,8 @@ void Player::handle_inventory_use() {
 void Player::throw_out_item(std::shared_ptr<Item> item) const {
     float angle = RangeOfFloat(0, 2 * PI).get_random();
     float len = pick_up_range * 1.5;
-    sf::Vector2f item_position = position + sf::Vector2f(std::cos(angle), std::sin(angle)) * len;
+    sf::Vector2f item_position =
+        position() + sf::Vector2f(std::cos(angle), std::sin(angle)) * len;
     Game::get().dungeon.current_level->laying_items.push_back(LayingItem(item, item_position));
 }
 
@@ -1674,16 +2524,22 @@ bool Player::pick_up_item(std::shared_ptr<Item> item) {
 void Player::handle_picking_up_items() {
     if (!sf::Keyboard::isKeyPressed(sf::Keyboard::E)) return;
 
-    std::vector<LayingItem> &laying_items = Game::get().dungeon.current_level->laying_items;
+    auto &level = Game::get().dungeon.current_level;
+    SlotMap<LayingItem, BodyStore> &laying_items = level->laying_items;
 
     // laying_items can become larger (but should not go smaller, but still) during the loop
-    size_t size = laying_items.size();
-    for (size_t i = 0; i < std::min(size, laying_items.size()); ++i) {
+    static thread_local SpatialQuery nearby;
+    level->query_radius(position(), pick_up_range, nearby);
+    for (size_t i : nearby.laying_items) {
+        if (i >= laying_items.size()) continue;
         LayingItem &item = laying_items[i];
         if (!item.picked_up && item.since_last_pick_up.getElapsedTime() > pick_up_timeout &&
-            length_squared(item.position - position) <= pick_up_range * pick_up_range)
+            length_squared(item.position() - position()) <= pick_up_range * pick_up_range)
         {
-            if (pick_up_item(item.item)) {
+            while (item.count > 0 && pick_up_item(item.item)) {
+                --item.count;
+            }
+            if (item.count == 0) {
                 item.picked_up = true;
             }
         }
@@ -1704,17 +2560,42 @@ void Player::die(Actor &reason) { alive = false; }
 
 void Enemy::init() {}
 
-void Enemy::fixed_update(float delta_time) {
-    RigidBody::fixed_update(delta_time);
+void Enemy::update(float delta_time) {
+    if (!alive) return;
+    think();
+    handle_equipment_use();
+}
 
+void Enemy::background_update(float delta_time) {
+    apply_friction();
+    RigidBody::fixed_update(delta_time);
     if (!alive) return;
 
-    handle_movement(delta_time);
+    // the behaviours need the player, so far from the player enemies only go home
+    EnemyBrain *mind = brain.get();
+    if (!mind) return;
+    float distance = length(mind->home - position());
+    if (distance < 0.1f) return;
+    float speed = characteristics.speed * mind->patrol_speed_factor;
+    move(mind->home - position(), std::min(speed, distance / delta_time), delta_time);
 }
 
-void Enemy::update(float delta_time) {
-    if (!alive) return;
-    handle_equipment_use();
+Behaviour Enemy::behave(EnemyBrain &brain) { return hunt(brain); }
+
+void Enemy::think() {
+    EnemyBrain *mind = brain.get();
+    if (!mind) {
+        mind = &brain.create();
+        mind->home = position();
+        mind->gen.seed(seed);  // the same level plays out the same way
+    }
+    mind->self = this;
+
+    BehaviourScheduler &scheduler = Game::get().dungeon.current_level->behaviours;
+    if (!scheduler.tick(*mind) && mind->root.is_done()) {
+        mind->root = behave(*mind);
+        mind->root.start();
+    }
 }
 
 bool Enemy::pick_up_item(std::shared_ptr<Item> item) {
@@ -1728,7 +2609,153 @@ bool Enemy::pick_up_item(std::shared_ptr<Item> item) {
 }
 
 void Enemy::handle_movement(float delta_time) {
-    move(Game::get().dungeon.player.position - position, characteristics.speed, delta_time);
+    EnemyBrain *mind = brain.get();
+    if (!mind) return;
+    mind->self = this;
+    mind->follow_path();
+    move(mind->steering_direction(), characteristics.speed * mind->speed_factor, delta_time);
+}
+
+void EnemyBrain::steer(Steering steering, float speed_factor) {
+    this->steering = steering;
+    this->speed_factor = speed_factor;
+}
+
+void EnemyBrain::steer_to(sf::Vector2f target, float speed_factor) {
+    this->target = target;
+    steer(TowardsTarget, speed_factor);
+
+    auto &level = Game::get().dungeon.current_level;
+    path = level && self ? level->request_path(self->position(), target) : nullptr;
+    path_step = 0;
+}
+
+/*!
+Moves on to the next tile of the path once the current one is reached.
+A few tiles are looked ahead, in case the enemy was pushed along the way.
+*/
+void EnemyBrain::follow_path() {
+    if (steering != TowardsTarget || !path || !path->is_done()) return;
+    auto &level = Game::get().dungeon.current_level;
+    if (!level) return;
+    auto coords = level->get_tile_coordinates(self->position());
+    if (!coords) return;
+
+    const Path &tiles = *path->path;
+    size_t end = std::min(tiles.size(), path_step + path_look_ahead);
+    for (size_t i = path_step; i < end; ++i) {
+        if (tiles[i] == *coords) path_step = i + 1;
+    }
+}
+
+sf::Vector2f EnemyBrain::steering_direction() const {
+    if (steering == TowardsTarget) {
+        // the last tile holds the target itself, so the path is only followed up to it
+        sf::Vector2f goal = target;
+        if (path && path->is_done() && path_step + 1 < path->path->size()) {
+            goal = Game::get().dungeon.current_level->tile_center((*path->path)[path_step]);
+        }
+        sf::Vector2f offset = goal - self->position();
+        // do not jitter around the target
+        if (length_squared(offset) < arrival_distance * arrival_distance) return {0, 0};
+        return offset;
+    }
+    if (steering == TowardsPlayer) {
+        // around the walls if there is a way, straight when already next to the player
+        DungeonLevel &level = *Game::get().dungeon.current_level;
+        sf::Vector2f direction = level.flow_direction(self->position());
+        if (direction != sf::Vector2f(0, 0)) return direction;
+        return player_position() - self->position();
+    }
+    return {0, 0};
+}
+
+bool EnemyBrain::has_reached_target() const {
+    return length_squared(target - self->position()) < arrival_distance * arrival_distance;
+}
+
+sf::Vector2f EnemyBrain::player_position() const {
+    return Game::get().dungeon.current_level->world_state.read().player.position;
+}
+
+float EnemyBrain::distance_to_player() const {
+    return length(player_position() - self->position());
+}
+
+bool EnemyBrain::can_see_player() const { return self->sees_player; }
+
+bool EnemyBrain::is_weapon_cooling_down() const {
+    const StackOfItems &weapon = self->equipment.weapon();
+    if (!weapon) return false;
+    auto cooldown = dynamic_cast<const WeaponWithCooldown *>(weapon.item.get());
+    return cooldown && cooldown->on_cooldown &&
+           cooldown->since_last_use.getElapsedTime() <= cooldown->cooldown_time;
+}
+
+// the behaviours do not keep references to the enemy across the waits,
+// since the enemy can be moved in between, `brain.self` is always up to date
+
+Behaviour patrol(EnemyBrain &brain, float duration) {
+    RangeOfFloat offset(-brain.patrol_radius, brain.patrol_radius);
+    float until = brain.get_now() + duration;
+    while (brain.get_now() < until) {
+        sf::Vector2f target =
+            brain.home + sf::Vector2f(offset.get_random(brain.gen), offset.get_random(brain.gen));
+        brain.steer_to(target, brain.patrol_speed_factor);
+
+        // nothing to decide on the way, and the path around the walls can be much longer
+        // than the straight line, so only the arrival is checked until the patrol is over
+        co_await brain.wait_until([&brain, until]() {
+            return brain.has_reached_target() || brain.get_now() >= until;
+        });
+
+        brain.steer(EnemyBrain::Stop);
+        co_await brain.wait_for(0.5f);
+    }
+}
+
+Behaviour chase(EnemyBrain &brain, float duration) {
+    // the steering follows the player on its own, only the end of the chase is awaited
+    brain.steer(EnemyBrain::TowardsPlayer);
+    co_await brain.wait_for(duration);
+}
+
+Behaviour flee(EnemyBrain &brain, float duration) {
+    // runs for the point it could reach in a straight line, but around the walls
+    sf::Vector2f away = brain.self->position() - brain.player_position();
+    float distance = length(away);
+    if (distance > 0) {
+        float reach = brain.self->characteristics.speed * duration;
+        brain.steer_to(brain.self->position() + away / distance * reach);
+    } else {
+        brain.steer(EnemyBrain::Stop);
+    }
+    co_await brain.wait_for(duration);
+}
+
+Behaviour wait_for_cooldown(EnemyBrain &brain) {
+    brain.steer(EnemyBrain::Stop);
+    co_await brain.wait_until([&brain]() { return !brain.is_weapon_cooling_down(); });
+}
+
+Behaviour hunt(EnemyBrain &brain) {
+    while (true) {
+        // choosing what to do is the expensive part, so the scheduler spreads it over frames
+        co_await brain.decide();
+
+        bool is_hurt =
+            brain.self->health < brain.self->characteristics.max_health * brain.flee_health_ratio;
+
+        if (!brain.can_see_player()) {
+            co_await patrol(brain, 2.0f);
+        } else if (is_hurt) {
+            co_await flee(brain, 1.0f);
+        } else if (brain.is_weapon_cooling_down()) {
+            co_await wait_for_cooldown(brain);
+        } else {
+            co_await chase(brain, 0.5f);
+        }
+    }
 }
 
 void Enemy::handle_equipment_use() {
@@ -1744,18 +2771,27 @@ void Enemy::die(Actor &reason) {
     reason.experience.gain(experience.as_value_after_death());
 }
 
-void Enemy::on_deletion() {
-    auto &level = Game::get().dungeon.current_level;
-    if (!level) return;
-
+void Enemy::on_deletion(std::vector<LayingItem> &drops) {
     RangeOfLong range_chest_item(0, Game::get().item_templates.size() - 1);
     std::shared_ptr<Item> item = Game::get().make_item(range_chest_item.get_random());
+    drops.emplace_back(item, position());
+}
 
-    LayingItem laying_item(item, position);
-    level->laying_items.push_back(laying_item);
+// otherwise the enemies are copied when their vector grows, and a copy has no brain
+static_assert(std::is_nothrow_move_constructible_v<Enemy>);
+
+DeepCopyCls(Enemy) {
+    Actor::deepcopy_to(other);
+    other.seed = seed;
 }
 
-DeepCopyCls(Enemy) { Actor::deepcopy_to(other); }
+DeepCopyCls(LayingItem) {
+    RigidBody::deepcopy_to(other);
+    if (item) other.item = item->deepcopy_item();
+    other.count = count;
+    other.picked_up = picked_up;
+    other.generated = generated;
+}
 
 void Item::update_owner_characteristics(Characteristics &characteristics) {
     auto &artefact = get_class().artefact;
@@ -1789,19 +2825,15 @@ DeepCopyCls(WeaponWithCooldown) {
     other.on_cooldown = on_cooldown;
 }
 
-bool MeleeWeapon::try_to_attack(Actor &source, Actor &target) {
-    std::unique_lock<std::mutex> lck(*target.mut);
-
-    if (!is_in_range(source, target.position)) return false;
+bool MeleeWeapon::try_to_attack(Actor &source, Actor &target, const ActorState &target_state) {
+    if (!is_in_range(source, target_state.position)) return false;
 
     float damage = get_damage(target);
     if (enchantment) damage = enchantment->apply(damage, target);
 
-    target.apply_force(
-        -normalized(source.position - target.position) * damage / (float)damage_range.max *
-        push_back_force_multiplier
-    );
-    target.take_damage(damage, source);
+    sf::Vector2f force = -normalized(source.position() - target_state.position) * damage /
+                         (float)damage_range.max * push_back_force_multiplier;
+    Game::get().dungeon.current_level->damage_commands.push({&source, &target, damage, force});
 
     return true;
 }
@@ -1822,12 +2854,20 @@ ItemUseResult MeleeWeapon::use(Actor &source) {
 
     bool reached_anything = false;
 
+    auto &level = Game::get().dungeon.current_level;
+    const WorldSnapshot &snapshot = level->world_state.read();
+
     if (source.actor_class_index == Game::player_class_index) {
-        for (auto &enemy : Game::get().dungeon.current_level->enemies) {
-            reached_anything = try_to_attack(source, enemy) || reached_anything;
+        static thread_local SpatialQuery nearby;
+        level->query_radius(source.position(), get_reach(), nearby);
+        for (size_t i : nearby.enemies) {
+            if (i >= level->enemies.size()) continue;
+            const ActorState &state = snapshot.enemies[i - snapshot.first_enemy];
+            reached_anything = try_to_attack(source, level->enemies[i], state) || reached_anything;
         }
     } else {
-        reached_anything = try_to_attack(source, Game::get().dungeon.player) || reached_anything;
+        reached_anything =
+            try_to_attack(source, Game::get().dungeon.player, snapshot.player) || reached_anything;
     }
 
     if (reached_anything) ensure_cooldown();
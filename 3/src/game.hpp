@@ -11,8 +11,8 @@
 #include <SFML/System/Vector2.hpp>
 #include <array>
 #include <atomic>
-#include <barrier>
 #include <functional>
+#include <limits>
 // clang-format off
 #include <boost/config.hpp>
 #include <boost/optional.hpp>
@@ -29,7 +29,6 @@
 #include <boost/serialization/variant.hpp>
 #include <boost/serialization/vector.hpp>
 // clang-format on
-#include <condition_variable>
 #include <memory>
 #include <mutex>
 #include <random>
@@ -39,13 +38,23 @@
 #include <utility>
 #include <vector>
 
+#include "asset_loader.hpp"
+#include "background_saver.hpp"
+#include "behaviour.hpp"
+#include "body_store.hpp"
+#include "compaction.hpp"
 #include "deepcopy.hpp"
+#include "flow_field.hpp"
+#include "job_system.hpp"
 #include "matrix.hpp"
 #include "missing_serializers.hpp"
+#include "pathfinding.hpp"
 #include "shared.hpp"
+#include "slot_map.hpp"
+#include "uniform_grid.hpp"
+#include "work_tuner.hpp"
 #include "vector_operations.hpp"
-
-static const size_t thread_count = std::thread::hardware_concurrency();
+#include "visibility.hpp"
 
 BOOST_CLASS_EXPORT_KEY(sf::Vector2f);
 
@@ -165,8 +174,23 @@ private:
 BOOST_CLASS_EXPORT_KEY(CharacteristicsModifier);
 
 class GAME_API Actor;
+class GAME_API LayingItem;
 class GAME_API ItemClass;
 
+/*!
+The part of an actor that other actors are allowed to look at during a parallel phase.
+*/
+class GAME_API ActorState {
+public:
+    sf::Vector2f position;
+    sf::Vector2f velocity;
+    float size = 0.0f;
+    float health = 0.0f;
+    bool alive = false;
+
+    static ActorState of(const Actor &actor);
+};
+
 class GAME_API ItemUseResult {
 public:
     bool was_broken = false;
@@ -305,7 +329,7 @@ public:
     ItemsView(sf::RenderWindow &window) : window(window) {}
     ~ItemsView() = default;
 
-    void draw(const Item &item, sf::Vector2f position);
+    void draw(size_t item_class_index, sf::Vector2f position);
 };
 
 class GAME_API Potion : public Item {
@@ -332,6 +356,14 @@ public:
     T get_random() {
         std::random_device rd;
         std::mt19937 gen(rd());
+        return get_random(gen);
+    }
+
+    /*!
+    Draws the value from the given generator, so the sequence can be reproduced from its seed.
+    */
+    template <typename Generator>
+    T get_random(Generator &gen) const {
         if constexpr (std::is_integral_v<T>) {
             std::uniform_int_distribution<T> dis(min, max);
             return dis(gen);
@@ -388,10 +420,15 @@ public:
     Weapon(size_t item_class_index, RangeOfLong damage_range)
         : Item(item_class_index), damage_range(damage_range) {}
 
-    virtual bool try_to_attack(Actor &source, Actor &target) = 0;
+    virtual bool try_to_attack(Actor &source, Actor &target, const ActorState &target_state) = 0;
     virtual float get_damage(Actor &target);
     virtual bool is_in_range(const Actor &source, sf::Vector2f target) const = 0;
 
+    /*!
+    Returns the distance from the source beyond which `is_in_range` is always false.
+    */
+    virtual float get_reach() const { return std::numeric_limits<float>::infinity(); }
+
 private:
     friend class boost::serialization::access;
 
@@ -453,7 +490,7 @@ public:
     ItemUseResult use(Actor &source) override;
     bool test_cooldown();
     void ensure_cooldown();
-    bool try_to_attack(Actor &source, Actor &target) override;
+    bool try_to_attack(Actor &source, Actor &target, const ActorState &target_state) override;
 
 private:
     friend class boost::serialization::access;
@@ -565,6 +602,17 @@ private:
 
 BOOST_CLASS_EXPORT_KEY(Inventory);
 
+/*!
+What the ui needs to know about a slot of the inventory or equipment.
+*/
+class GAME_API SlotSprite {
+public:
+    size_t item_class_index = 0;
+    size_t count = 0;  // 0 for an empty slot
+
+    static SlotSprite of(const StackOfItems &stack);
+};
+
 class GAME_API StackOfItemsView {
     sf::RenderWindow &window;
 
@@ -579,7 +627,7 @@ public:
     StackOfItemsView(sf::RenderWindow &window) : window(window) {}
 
     void init();
-    void draw(const StackOfItems &stack, sf::Vector2f position, float size, bool selected);
+    void draw(const SlotSprite &stack, sf::Vector2f position, float size, bool selected);
 };
 
 class GAME_API HolderOfItemsView {
@@ -593,7 +641,7 @@ public:
     HolderOfItemsView(sf::RenderWindow &window) : window(window), stack_of_items_view(window) {}
 
     void init();
-    void draw(const StackOfItems *slots, size_t count, size_t selection);
+    void draw(const std::vector<SlotSprite> &slots, size_t selection);
 };
 
 class GAME_API Chest {
@@ -604,6 +652,8 @@ public:
     Chest() = default;
     Chest(size_t level) : inventory(1), level(level) {}
 
+    DeepCopy(Chest);
+
     LockPickingResult simulate_picking(const Actor &source);
 
 private:
@@ -637,10 +687,13 @@ public:
     Tile() : Tile(Barrier) {}
     Tile(Kind kind) : building(nullptr), kind(kind) {}
 
+    DeepCopy(Tile);
+
     bool operator==(const Tile &other) const = default;
     bool operator!=(const Tile &other) const = default;
 
     Tile &set_building(std::shared_ptr<Chest> building);
+    bool is_passable() const;
 
 private:
     friend class boost::serialization::access;
@@ -654,6 +707,14 @@ private:
 
 BOOST_CLASS_EXPORT_KEY(Tile);
 
+class GAME_API TileSprite {
+public:
+    Tile::Kind kind;
+    bool has_chest;
+    size_t x;
+    size_t y;
+};
+
 class GAME_API Experience {
 public:
     size_t level;
@@ -741,28 +802,73 @@ private:
 
 BOOST_CLASS_EXPORT_KEY(Equipment);
 
+/*!
+While the body is bound to a row of a `BodyStore`, its data lives in that row,
+so the physics passes go over the packed arrays of the store. Otherwise the body
+keeps the data itself. The accessors work the same either way.
+A copy of a body is never bound, an assignment writes into the row of the assigned body.
+*/
 class GAME_API RigidBody {
 public:
     DeepCopy(RigidBody);
 
-    float size = 1.0f;
-    float mass = 1.0f;
-    float friction_coefficient = 2.0f;  // mu * gravity
+    RigidBody() = default;
+    RigidBody(float size, float mass) {
+        data.size = size;
+        data.mass = mass;
+    }
+    RigidBody(sf::Vector2f position) { data.position = position; }
+    RigidBody(sf::Vector2f position, float size, float mass) {
+        data.size = size;
+        data.mass = mass;
+        data.position = position;
+    }
+    // noexcept, so the vectors of the derived objects still move them when they grow
+    RigidBody(const RigidBody &other) noexcept : data(other.get_data()) {}
+    RigidBody &operator=(const RigidBody &other) noexcept {
+        set_data(other.get_data());
+        return *this;
+    }
+    virtual ~RigidBody() = default;
+
+    float &size() { return store ? store->sizes[row] : data.size; }
+    float size() const { return store ? store->sizes[row] : data.size; }
+    float &mass() { return store ? store->masses[row] : data.mass; }
+    float mass() const { return store ? store->masses[row] : data.mass; }
+    float &friction_coefficient() {
+        return store ? store->frictions[row] : data.friction_coefficient;
+    }
+    float friction_coefficient() const {
+        return store ? store->frictions[row] : data.friction_coefficient;
+    }
 
-    sf::Vector2f position;
-    sf::Vector2f velocity;
-    sf::Vector2f acceleration;
+    sf::Vector2f &position() { return store ? store->positions[row] : data.position; }
+    sf::Vector2f position() const { return store ? store->positions[row] : data.position; }
+    sf::Vector2f &velocity() { return store ? store->velocities[row] : data.velocity; }
+    sf::Vector2f velocity() const { return store ? store->velocities[row] : data.velocity; }
+    sf::Vector2f &acceleration() { return store ? store->accelerations[row] : data.acceleration; }
+    sf::Vector2f acceleration() const {
+        return store ? store->accelerations[row] : data.acceleration;
+    }
 
-    std::shared_ptr<std::mutex> mut;
+    std::uint8_t &pushable() { return store ? store->pushable[row] : data.pushable; }
+    bool pushable() const { return store ? store->pushable[row] : data.pushable; }
 
-    bool pushable = true;
+    BodyData get_data() const { return store ? store->read(row) : data; }
+    void set_data(const BodyData &data);
 
-    RigidBody() : mut(std::make_shared<std::mutex>()) {}
-    RigidBody(float size, float mass)
-        : mut(std::make_shared<std::mutex>()), size(size), mass(mass) {}
-    RigidBody(sf::Vector2f position) : mut(std::make_shared<std::mutex>()), position(position) {}
-    RigidBody(sf::Vector2f position, float size, float mass)
-        : mut(std::make_shared<std::mutex>()), size(size), mass(mass), position(position) {}
+    /*!
+    Moves the data of the body to the `row` of the `store`, the row must exist.
+    */
+    void bind(BodyStore *store, size_t row);
+    /*!
+    Points the body to the `row` that already holds its data, after the body was moved.
+    */
+    void rebind(BodyStore *store, size_t row);
+    /*!
+    Takes the data back from the row.
+    */
+    void unbind();
 
     void apply_force(sf::Vector2f forece);
     void apply_impulse(sf::Vector2f impulse);
@@ -775,17 +881,23 @@ public:
     sf::FloatRect get_axes_aligned_bounding_box() const;
 
 private:
+    BodyData data;
+    BodyStore *store = nullptr;
+    size_t row = 0;
+
     friend class boost::serialization::access;
 
     template <class Archive>
     void serialize(Archive &ar, const unsigned int version) {
-        ar &size;
-        ar &mass;
-        ar &friction_coefficient;
-        ar &position;
-        ar &velocity;
-        ar &acceleration;
-        ar &pushable;
+        ar &size();
+        ar &mass();
+        ar &friction_coefficient();
+        ar &position();
+        ar &velocity();
+        ar &acceleration();
+        bool is_pushable = pushable();
+        ar &is_pushable;
+        pushable() = is_pushable;
     }
 };
 
@@ -844,13 +956,18 @@ public:
           characteristics(characteristics),
           base_characteristics(characteristics),
           experience(level) {}
+    // the destructor would otherwise hide the moves
+    Actor(const Actor &) = default;
+    Actor(Actor &&) = default;
+    Actor &operator=(const Actor &) = default;
+    Actor &operator=(Actor &&) = default;
     virtual ~Actor() = default;
 
     virtual void init(){};
     virtual void update(float delta_time){};
     virtual void die(Actor &reason){};
     virtual bool pick_up_item(std::shared_ptr<Item> item) { return false; };
-    virtual void on_deletion(){};
+    virtual void on_deletion(std::vector<LayingItem> &drops){};
     virtual void recalculate_characteristics();
 
     void take_damage(float amount, Actor &source);
@@ -887,9 +1004,30 @@ public:
 
     sf::Time duration;
 
+    sf::Color color_at(sf::Time elapsed_time) const;
     void update(sf::Time elapsed_time, sf::Sprite &sprite);
 };
 
+/*!
+Everything needed to draw an actor, copied out of the simulation.
+*/
+class GAME_API ActorSprite {
+public:
+    size_t actor_class_index;
+    sf::Vector2f position;
+    float size;
+    sf::Color color;
+    bool has_weapon;
+    size_t weapon_class_index;
+    float health_ratio;
+};
+
+class GAME_API ItemSprite {
+public:
+    size_t item_class_index;
+    sf::Vector2f position;
+};
+
 class GAME_API ActorsView {
 private:
     sf::RenderWindow &window;
@@ -909,8 +1047,9 @@ public:
           health_bar(window, set_alpha(sf::Color::White, 127), set_alpha(sf::Color::Green, 127)),
           items_view(window) {}
 
-    void draw(const Actor &actor);
-    void draw_ui(const Actor &actor);
+    ActorSprite extract(const Actor &actor) const;
+    void draw(const ActorSprite &actor);
+    void draw_ui(const ActorSprite &actor);
 };
 
 static const sf::Time pick_up_timeout = sf::seconds(1.0f);
@@ -928,7 +1067,6 @@ public:
     Player(const Actor &actor) : Actor(actor) {}
 
     void init() override;
-    void fixed_update(float delta_time) override;
     void update(float delta_time) override;
     void handle_movement(float delta_time);
     void handle_equipment_use();
@@ -954,22 +1092,104 @@ private:
 
 BOOST_CLASS_EXPORT_KEY(Player);
 
+class GAME_API Enemy;
+
+/*!
+The behaviour state of one enemy. It lives on the heap,
+so the coroutines can keep referring to it while the enemies are moved around.
+*/
+class GAME_API EnemyBrain : public BehaviourContext {
+public:
+    enum Steering {
+        Stop,
+        TowardsTarget,
+        TowardsPlayer,
+    };
+
+    Enemy *self = nullptr;  // refreshed before every tick
+    Behaviour root;
+    std::mt19937 gen;
+
+    sf::Vector2f home;  // the patrols go around it
+    Steering steering = Stop;
+    sf::Vector2f target;
+    std::shared_ptr<const PathRequest> path;  // to the target, straight until it is found
+    size_t path_step = 0;  // the next tile of the path to go to
+    float speed_factor = 1.0f;
+
+    float sight_radius = 6.0f;
+    float patrol_radius = 2.0f;
+    float patrol_speed_factor = 0.4f;
+    float flee_health_ratio = 0.25f;
+
+    static constexpr size_t path_look_ahead = 4;
+    static constexpr float arrival_distance = 0.1f;  // the steering stops this close to its goal
+
+    void steer(Steering steering, float speed_factor = 1.0f);
+    void steer_to(sf::Vector2f target, float speed_factor = 1.0f);
+    void follow_path();
+    sf::Vector2f steering_direction() const;
+    bool has_reached_target() const;
+    sf::Vector2f player_position() const;
+    float distance_to_player() const;
+    bool can_see_player() const;
+    bool is_weapon_cooling_down() const;
+};
+
+/*!
+Owns the brain of an enemy. A running coroutine can not be copied,
+so a copy of an enemy starts thinking from scratch.
+*/
+class GAME_API BrainSlot {
+private:
+    std::unique_ptr<EnemyBrain> brain;
+
+public:
+    BrainSlot() = default;
+    BrainSlot(const BrainSlot &) {}
+    BrainSlot &operator=(const BrainSlot &) {
+        brain.reset();
+        return *this;
+    }
+    BrainSlot(BrainSlot &&) = default;
+    BrainSlot &operator=(BrainSlot &&) = default;
+
+    EnemyBrain *get() const { return brain.get(); }
+    EnemyBrain &create() {
+        brain = std::make_unique<EnemyBrain>();
+        return *brain;
+    }
+};
+
+Behaviour patrol(EnemyBrain &brain, float duration);
+Behaviour chase(EnemyBrain &brain, float duration);
+Behaviour flee(EnemyBrain &brain, float duration);
+Behaviour wait_for_cooldown(EnemyBrain &brain);
+Behaviour hunt(EnemyBrain &brain);
+
 class GAME_API Enemy : public Actor {
 public:
     DeepCopy(Enemy);
 
+    BrainSlot brain;
+    std::uint32_t seed = 0;  // of the brain, drawn from the generator of the level
+    float lod_delta_time = 0.0f;  // the time passed since the last update, see `LevelOfDetail`
+    bool sees_player = false;  // see `DungeonLevel::update_perception`
+
     Enemy() = default;
     Enemy(size_t class_index, float size, Characteristics characteristics, size_t level)
         : Actor(class_index, size, characteristics, level) {}
     Enemy(const Actor &actor) : Actor(actor) {}
 
     void init() override;
-    void fixed_update(float delta_time) override;
     void update(float delta_time) override;
+    void background_update(float delta_time);
+    virtual Behaviour behave(EnemyBrain &brain);
+    void think();
     void handle_movement(float delta_time);
     void handle_equipment_use();
     void die(Actor &reason) override;
-    void on_deletion() override;
+    void on_deletion(std::vector<LayingItem> &drops) override;
     bool pick_up_item(std::shared_ptr<Item> item) override;
 
 private:
@@ -978,15 +1198,19 @@ private:
     template <class Archive>
     void serialize(Archive &ar, const unsigned int version) {
         ar &BOOST_SERIALIZATION_BASE_OBJECT_NVP(Actor);
+        if (version >= 1) ar &seed;
     }
 };
 
 BOOST_CLASS_EXPORT_KEY(Enemy);
+BOOST_CLASS_VERSION(Enemy, 1);
 
 class GAME_API LayingItem : public RigidBody {
 public:
     std::shared_ptr<Item> item;
-    bool picked_up = false;
+    size_t count = 1;  // same as in the inventory, a stack shares one item
+    bool picked_up = false;  // also set when the item was merged into another stack
+    bool generated = false;  // spawned with the level, only such items are dropped above the cap
     sf::Clock since_last_pick_up;
 
     LayingItem() = default;
@@ -994,6 +1218,8 @@ public:
     LayingItem(std::shared_ptr<Item> item, sf::Vector2f position)
         : RigidBody(position), item(item) {}
 
+    DeepCopy(LayingItem);
+
 private:
     friend class boost::serialization::access;
 
@@ -1002,6 +1228,8 @@ private:
         ar &BOOST_SERIALIZATION_BASE_OBJECT_NVP(RigidBody);
         ar &item;
         ar &picked_up;
+        if (version >= 1) ar &count;
+        if (version >= 2) ar &generated;
         // fuck it for now
         // but overall it could be fixed
         // by having a sf::Time that since_last_pick_up will be subtracting from
@@ -1011,12 +1239,108 @@ private:
 };
 
 BOOST_CLASS_EXPORT_KEY(LayingItem);
+BOOST_CLASS_VERSION(LayingItem, 2);
+
+class GAME_API WorldSnapshot {
+public:
+    // follows DungeonLevel::enemies from `first_enemy`, the dormant ones are not published
+    std::vector<ActorState> enemies;
+    size_t first_enemy = 0;
+    ActorState player;
+};
+
+/*!
+Double-buffered snapshots of the actors. Enemy logic reads the snapshot of
+the previous phase, which nobody writes to, while the live actors move on.
+*/
+class GAME_API WorldState {
+private:
+    std::array<WorldSnapshot, 2> buffers;
+    size_t front = 0;
+
+public:
+    const WorldSnapshot &read() const { return buffers[front]; }
+    WorldSnapshot &write() { return buffers[1 - front]; }
+    void publish() { front = 1 - front; }
+};
+
+/*!
+The result of a spatial query of a level, the indices are in the increasing order.
+*/
+class GAME_API SpatialQuery {
+public:
+    std::vector<std::uint32_t> enemies;       // follows DungeonLevel::enemies
+    std::vector<std::uint32_t> laying_items;  // follows DungeonLevel::laying_items
+
+    void clear();
+};
+
+class GAME_API DamageCommand {
+public:
+    Actor *source;
+    Actor *target;
+    float damage;
+    sf::Vector2f force;
+};
+
+/*!
+Collects the attacks made during a parallel phase without any locking:
+every thread appends to its own buffer. The commands are applied later
+on a single thread, in an order that does not depend on the scheduling.
+*/
+class GAME_API DamageCommandBuffer {
+private:
+    struct alignas(64) ThreadCommands {
+        std::vector<DamageCommand> commands;
+    };
+
+    std::vector<ThreadCommands> per_thread = std::vector<ThreadCommands>(1);
+    std::vector<DamageCommand> merged;
+
+public:
+    DamageCommandBuffer() = default;
+    // the commands point into the level they were made in, so they are never copied
+    DamageCommandBuffer(const DamageCommandBuffer &) {}
+    DamageCommandBuffer &operator=(const DamageCommandBuffer &) {
+        clear();
+        return *this;
+    }
+
+    void prepare(size_t thread_count);
+    void push(const DamageCommand &command);
+    void apply();
+    void clear();
+};
+
+/*!
+How often the enemies are updated depending on their distance to the player, in tiles.
+Past `half_rate` the enemies think every second frame, past `quarter_rate` every fourth one,
+past `eighth_rate` every eighth one, and past `dormant` they stop entirely, physics included.
+The enemies seen by the camera are always updated at the full rate.
+*/
+class GAME_API LevelOfDetail {
+public:
+    static constexpr std::uint8_t dormant_lod = 0xff;
+
+    float half_rate = 16.0f;
+    float quarter_rate = 24.0f;
+    float eighth_rate = 32.0f;
+    float dormant = 48.0f;
+
+    std::uint8_t lod_of(float distance) const;
+};
 
 class GAME_API DungeonLevel {
 public:
-    std::vector<Enemy> enemies;
-    std::vector<LayingItem> laying_items;
+    // keep their handles across the frames, not the indices;
+    // the stores own the data of the bodies, the physics passes go over them
+    SlotMap<Enemy, BodyStore> enemies;
+    SlotMap<LayingItem, BodyStore> laying_items;
     Matrix<Tile> tiles;
+    FlowField flow_field;  // towards the player, the enemies follow it while chasing
+    PathService paths;  // to any other goal
+    SolidTileMap solid_tiles;  // block the sight of the enemies
+    VisibilityCache player_visibility;  // of the player from the tiles of the enemies
     sf::Vector2f initial_player_position;
     float tile_size = 10.0f;
     size_t max_chest_level = 9;
@@ -1024,26 +1348,89 @@ public:
     size_t actors_spawned_per_class = 100;
     size_t laying_items_spawned_per_class = 5;
     float rebounce_factor = 0.9f;
+    float laying_item_merge_radius = 0.5f;  // in tiles
+    size_t max_laying_items = 1000;  // the oldest generated items above it disappear
+    size_t dropped_laying_items = 0;  // by the cap, since the level was created
+
+    UniformGrid actor_grid;  // broadphase for actor-actor collitions, keyed on tiles
+    std::vector<sf::FloatRect> actor_boxes;  // scratch space of the actor-actor collitions
+    std::vector<sf::Vector2f> actor_corrections;  // same
+    UniformGrid enemy_index;  // over the published snapshot, keyed on tiles
+    UniformGrid item_index;
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> chest_tiles;  // sorted, see `set_building`
+    size_t region_size = 8;  // side of a region in tiles
+    // the dormant enemies come first and are left alone, the ones of region r
+    // are [dormant_offsets[r], dormant_offsets[r + 1])
+    size_t dormant_count = 0;
+    std::vector<std::uint32_t> dormant_offsets;
+    // the rest are sorted by region, the ones of region r are [offsets[r], offsets[r + 1])
+    std::vector<std::uint32_t> region_offsets;
+    std::vector<std::uint32_t> enemy_regions;  // scratch space of `regroup_enemies`
+    std::vector<std::uint32_t> regroup_sources;  // same
+    std::vector<std::vector<LayingItem>> drops;  // scratch space of `delete_dead_actors`
+    LevelOfDetail lod;
+    std::vector<std::uint8_t> region_lods;  // log2 of the update period or `dormant_lod`
+    std::vector<std::uint8_t> active_lods;  // follows the enemies from `dormant_count`
+    size_t lod_frame = 0;
+    std::shared_ptr<FlowField> next_flow_field;  // filled by `flow_field_job`
+    JobSystem::Handle flow_field_job;
+    BehaviourScheduler behaviours;
+    DamageCommandBuffer damage_commands;
+    WorldState world_state;
+
+    // the state of the background tick, see `background_update`
+    float background_time = 0.0f;
+    float background_delta_time = 0.0f;
+    size_t background_cursor = 0;
+
+    static constexpr size_t bodies_per_job = 64;
+    static constexpr float max_background_step = 0.5f;  // friction is stable below 1 / mu
+
+    DeepCopy(DungeonLevel);
 
     void init();
     float tile_coords_to_world_coords_factor() const;
     sf::Vector2f center() const;
     void resize_tiles(size_t width, size_t height);
     void regenerate();
-    void regenerate_tiles();
-    void regenerate_enemies();
-    void regenerate_laying_items();
+    void regenerate(std::uint32_t seed);
+    void regenerate_tiles(std::mt19937 &gen);
+    void regenerate_enemies(std::mt19937 &gen);
+    void regenerate_laying_items(std::mt19937 &gen);
     boost::optional<std::pair<size_t, size_t>> get_tile_coordinates(sf::Vector2f position) const;
     Tile *get_tile(sf::Vector2f position);
+    void set_building(size_t x, size_t y, std::shared_ptr<Chest> building);
+    void rebuild_chest_index();
+    boost::optional<std::pair<size_t, size_t>> find_nearest_chest(
+        size_t x, size_t y, float radius
+    ) const;
     void add_laying_item(std::unique_ptr<LayingItem> item);
+    std::vector<std::uint8_t> get_passable_tiles() const;
+    sf::Vector2f tile_center(TileCoords tile) const;
+    void update_flow_field();
+    void wait_flow_field();
+    sf::Vector2f flow_direction(sf::Vector2f position) const;
+    void update_paths();
+    void update_perception();
+    std::shared_ptr<const PathRequest> request_path(sf::Vector2f from, sf::Vector2f to);
+    size_t region_of(sf::Vector2f position) const;
+    void regroup_enemies();
+    void update_lod();
+    void publish_world_state();
+    void update_spatial_index();
+    void query_rect(const sf::FloatRect &rect, SpatialQuery &result) const;
+    void query_radius(sf::Vector2f center, float radius, SpatialQuery &result) const;
     void update(float delta_time);
-    void update_enemies_in_thread(float delta_time, size_t id);
+    void update_enemies(float delta_time);
     void fixed_update(float delta_time);
-    void handle_collitions();
-    void handle_actor_actor_collitions(std::vector<RigidBody *> &bodies);
-    void handle_rigid_body_level_collitions(std::vector<RigidBody *> &bodies);
+    void handle_collitions(size_t first, size_t end);
+    void handle_actor_actor_collitions(BodyStore &bodies, size_t first, size_t end);
+    void handle_rigid_body_level_collitions(BodyStore &bodies, size_t first, size_t end);
     void delete_dead_actors();
     void delete_picked_up_items();
+    void merge_laying_items();
+    void add_laying_items(std::vector<std::vector<LayingItem>> &batches);
+    bool background_update(float delta_time, float tick_time, float budget_us);
 
 private:
     friend class boost::serialization::access;
@@ -1059,12 +1446,19 @@ private:
         ar &actors_spawned_per_class;
         ar &laying_items_spawned_per_class;
         ar &rebounce_factor;
+        if constexpr (Archive::is_loading::value) {
+            rebuild_chest_index();
+            paths.invalidate();
+            solid_tiles.clear();
+        }
     }
 };
 
 BOOST_CLASS_EXPORT_KEY(DungeonLevel);
 BOOST_CLASS_EXPORT_KEY(Matrix<Tile>);
 
+class GAME_API RenderSnapshot;
+
 class GAME_API DungeonLevelView {
 private:
     sf::RenderWindow &window;
@@ -1099,10 +1493,11 @@ public:
     ~DungeonLevelView() = default;
 
     bool init();
-    void draw(const DungeonLevel &level);
+    void extract(const DungeonLevel &level, RenderSnapshot &frame) const;
+    void draw(const RenderSnapshot &frame);
 
 private:
-    void draw_tile(const Tile &tile, sf::Vector2f position, float size, float chest_size_factor);
+    void draw_tile(const TileSprite &tile, float factor, float chest_size_factor);
 };
 
 class GAME_API Dungeon {
@@ -1112,9 +1507,18 @@ public:
     long current_level_index = -1;
     Player player;
 
+    // the levels the player is not on keep living at a lower rate
+    bool simulate_background_levels = true;
+    float background_tick_time = 0.25f;
+    float background_tick_budget_us = 100.0f;  // per level and frame
+    JobSystem::Handle background;
+
+    DeepCopy(Dungeon);
+
     void init();
     void update(float delta_time);
-    void update_enemies_in_thread(float delta_time, size_t id);
+    void update_background_levels(float delta_time);
+    void wait_background_levels();
     void fixed_update(float delta_time);
     void add_level(const DungeonLevel &level);
     bool load_level(size_t index);
@@ -1135,6 +1539,73 @@ private:
 
 BOOST_CLASS_EXPORT_KEY(Dungeon);
 
+class GAME_API Game;
+
+/*!
+A deep copy of the changing part of the game, taken to be saved on another thread.
+The class tables and templates do not change after the start, so they are referenced.
+Serializes exactly as `Game` does, so the save is loaded back as a `Game`.
+*/
+class GAME_API SaveSnapshot {
+public:
+    Dungeon dungeon;
+    const std::vector<ActorClass> &actor_classes;
+    const Player &player_template;
+    const std::vector<Enemy> &enemy_templates;
+    const std::vector<ItemClass> &item_classes;
+    const std::vector<std::unique_ptr<Item>> &item_templates;
+    float fixed_delta_time_leftover;
+    bool is_inventory_selected;
+    float time_scale;
+    float time_scale_epsilon;
+
+    static std::shared_ptr<SaveSnapshot> of(const Game &game);
+
+private:
+    friend class boost::serialization::access;
+
+    template <class Archive>
+    void serialize(Archive &ar, const unsigned int version) {
+        ar &dungeon;
+        ar &actor_classes;
+        ar &player_template;
+        ar &enemy_templates;
+        ar &item_classes;
+        ar &item_templates;
+        ar &fixed_delta_time_leftover;
+        ar &is_inventory_selected;
+        ar &time_scale;
+        ar &time_scale_epsilon;
+    }
+};
+
+/*!
+A copy of everything the frame draws, taken at the start of the frame.
+The render thread only reads the snapshot, so the next simulation step
+can run at the same time as the frame is being drawn.
+*/
+class GAME_API RenderSnapshot {
+public:
+    bool is_in_game = false;
+    bool has_level = false;
+
+    float tile_factor = 1.0f;
+    float chest_size_factor = 1.0f;
+    std::vector<TileSprite> tiles;  // only the visible ones
+    std::vector<ItemSprite> items;
+    std::vector<ActorSprite> actors;  // the player is the last one
+
+    std::vector<SlotSprite> slots;
+    size_t selection = 0;
+    Experience experience;
+
+    sf::Vector2f player_position;
+    bool player_alive = true;
+    bool have_won = false;
+
+    std::string save_status;  // empty when there is nothing to show
+};
+
 class GAME_API GameView {
 public:
     sf::RenderWindow window;
@@ -1149,6 +1620,8 @@ public:
     LevelUpCanvas level_up_canvas;
     ExperienceView experience_view;
 
+    RenderSnapshot frame;
+
     sf::Texture logo_texture;
     sf::Sprite logo;
 
@@ -1156,6 +1629,7 @@ public:
     sf::Text menu_message;
     sf::Text info_message;
     sf::Text important_message;
+    sf::Text save_status_message;
 
     GameView()
         : window(),
@@ -1166,6 +1640,8 @@ public:
     ~GameView() = default;
 
     bool init(unsigned int width, unsigned int height);
+    void extract_frame();
+    void draw_frame();
     void draw();
     bool is_open() const;
     void clear();
@@ -1177,27 +1653,6 @@ public:
     }
 };
 
-class GAME_API EnemyThreads {
-public:
-    std::vector<std::thread> threads;
-    std::mutex sync_mutex;
-    std::condition_variable children_cv;
-    std::condition_variable parent_cv;
-    bool is_shutting_down = false;
-    bool can_start_update = false;
-    float delta_time;
-
-    std::unique_ptr<std::barrier<std::function<void()>>> sync_point;
-
-    ~EnemyThreads();
-
-    void init();
-    void run(size_t id);
-    void start_updates();
-    void join_updates();
-    void shutdown();
-};
-
 class GAME_API Game {
 public:
     // declare item plugins before the anything that can contain the items,
@@ -1211,10 +1666,15 @@ public:
 
     Dungeon dungeon;
 
-    EnemyThreads enemy_threads;
+    size_t thread_count = std::thread::hardware_concurrency();  // shared by all the parallel phases
+    JobSystem jobs;
+    WorkTuner enemy_update_tuner;
+    WorkTuner enemy_fixed_update_tuner;
+    AssetLoader assets;
 
     bool have_won = false;
     bool is_in_game = false;
+    bool is_headless = false;  // no window and no input, the player stands still
     bool is_playing() const;
 
     static constexpr float view_size = 10.0f;   // sets up the view size
@@ -1235,20 +1695,44 @@ public:
     float time_scale = 1.0f;
     float time_scale_epsilon = 1e-6;
 
-    Game() = default;
+    // after everything the saves refer to, so it finishes writing before they are gone
+    BackgroundSaver saver;
+
+    Game();
     ~Game() = default;
 
+    /*!
+    Returns the game of the current thread: the one of the innermost `Scope`,
+    the one whose job system runs this thread, or the process wide game otherwise.
+    */
     static Game &get(bool brand_new = false);
 
+    /*!
+    Makes `Game::get` return `game` on this thread until the scope ends,
+    so several games can be simulated at once, one per thread.
+    */
+    class GAME_API Scope {
+    private:
+        Game *previous;
+
+    public:
+        explicit Scope(Game &game);
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+        ~Scope();
+    };
+
     bool init(unsigned int width, unsigned int height);
+    bool init_headless();
+    void step(float delta_time);
     void update(float delta_time);
-    void update_enemies_in_thread(float delta_time, size_t id);
     void handle_fixed_update(float delta_time);
     bool run();
     void handle_events();
     void start_playing();
     void stop_playing();
     void save(const std::string &filename);
+    void save_in_background(const std::string &filename);
     void load(const std::string &filename);
     void handle_save_load();
     bool load_config(const std::string &filename);
@@ -22,9 +22,11 @@ public:
     std::shared_ptr<Item> deepcopy_item() const override { return deepcopy_shared(*this); }
 
     bool is_in_range(const Actor &source, sf::Vector2f target) const override {
-        return length_squared(source.position - target) <= hit_range * hit_range;
+        return length_squared(source.position() - target) <= hit_range * hit_range;
     }
 
+    float get_reach() const override { return hit_range; }
+
 private:
     friend class boost::serialization::access;
 
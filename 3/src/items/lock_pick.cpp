@@ -31,34 +31,12 @@ const Tile *LockPick::find_best_choice(Actor &target) const {
     auto &level = Game::get().dungeon.current_level;
     if (!level) return nullptr;
 
-    auto coords = level->get_tile_coordinates(target.position);
+    auto coords = level->get_tile_coordinates(target.position());
     if (!coords) return nullptr;
 
-    auto iter = level->tiles.find([&coords, &level](const Tile &tile) -> bool {
-        auto [i, j] = level->tiles.indices_of(tile);
-        float distance =
-            length_squared(sf::Vector2f(i, j) - sf::Vector2f(coords->first, coords->second));
-        bool close_enough = distance <= picking_range * picking_range;
-        return close_enough && tile.building;
-    });
-
-    const Tile *closest_tile = nullptr;
-    float min_dist_sqared =
-        length_squared(sf::Vector2f(level->tiles.row_count(), level->tiles.column_count()));
-    for (; iter != level->tiles.end(); ++iter) {
-        auto &tile = *iter;
-        if (!tile.building) continue;
-        auto [i, j] = level->tiles.indices_of(tile);
-        std::cout << "iter " << i << " " << j << std::endl;
-
-        float item_dist_sqared =
-            length_squared(sf::Vector2f(i, j) - sf::Vector2f(coords->first, coords->second));
-        if (item_dist_sqared < min_dist_sqared) {
-            min_dist_sqared = item_dist_sqared;
-            closest_tile = &tile;
-        }
-    }
-    return closest_tile;
+    auto chest = level->find_nearest_chest(coords->first, coords->second, picking_range);
+    if (!chest) return nullptr;
+    return &level->tiles[chest->first][chest->second];
 }
 
 ItemUseResult LockPick::use(Actor &target) {
@@ -81,7 +59,7 @@ ItemUseResult LockPick::use(Actor &target) {
                 level->laying_items.push_back(laying_item);
             }
         }
-        tile->building = nullptr;
+        level->set_building(x, y, nullptr);
     }
 
     return ItemUseResult(result.pick_broken);
@@ -0,0 +1,299 @@
+#pragma once
+
+#ifndef JOB_SYSTEM_HPP
+#define JOB_SYSTEM_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*!
+A persistent pool of worker threads with per-thread work-stealing queues.
+The thread that calls `parallel_for` participates in the work, so a system
+initialized with `n` threads spawns `n - 1` workers.
+*/
+class JobSystem {
+private:
+    struct Batch {
+        void (*run)(void *context, size_t begin, size_t end);
+        void *context;
+        std::atomic<size_t> remaining;
+    };
+
+    struct AsyncJob {
+        std::function<void()> fn;
+        std::atomic<bool> done = false;
+    };
+
+    struct Task {
+        Batch *batch;
+        size_t begin;
+        size_t end;
+        std::shared_ptr<AsyncJob> async;  // set for the jobs started with `async`
+    };
+
+    // padded, so that neighbouring queues do not share a cache line
+    struct alignas(64) Queue {
+        std::mutex mut;
+        std::deque<Task> tasks;
+    };
+
+    struct ThreadInfo {
+        const JobSystem *owner = nullptr;
+        size_t index = 0;
+    };
+
+    static ThreadInfo &this_thread() {
+        static thread_local ThreadInfo info;
+        return info;
+    }
+
+    std::vector<std::thread> threads;
+    std::unique_ptr<Queue[]> queues = std::make_unique<Queue[]>(1);
+    size_t queue_count = 1;
+
+    std::atomic<std::uint32_t> epoch = 0;  // bumped every time new work is pushed
+    std::atomic<bool> is_shutting_down = false;
+
+public:
+    /*!
+    Refers to a job started with `async`. A default constructed handle is always done.
+    */
+    class Handle {
+    private:
+        std::shared_ptr<AsyncJob> job;
+
+        friend class JobSystem;
+
+    public:
+        Handle() = default;
+
+        bool is_done() const { return !job || job->done.load(std::memory_order_acquire); }
+    };
+
+    // called on every worker before it runs any job
+    std::function<void()> on_worker_start;
+
+    JobSystem() = default;
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    /*!
+    Stops and joins all the workers.
+    */
+    ~JobSystem() { shutdown(); }
+
+    /*!
+    Starts the workers. `thread_count` includes the calling thread.
+    Does nothing if the system is already running.
+    */
+    void init(size_t thread_count) {
+        if (!threads.empty()) return;
+
+        thread_count = std::max<size_t>(thread_count, 1);
+        is_shutting_down = false;
+        queue_count = thread_count;
+        queues = std::make_unique<Queue[]>(queue_count);
+
+        threads.reserve(queue_count - 1);
+        for (size_t i = 1; i < queue_count; ++i) {
+            threads.emplace_back(&JobSystem::run_worker, this, i);
+        }
+    }
+
+    /*!
+    Wakes all the workers up and waits for them to exit.
+    Must not be called while a `parallel_for` is in progress.
+    */
+    void shutdown() {
+        is_shutting_down = true;
+        epoch.fetch_add(1, std::memory_order_release);
+        epoch.notify_all();
+
+        for (auto &thread : threads) {
+            if (thread.joinable()) thread.join();
+        }
+        threads.clear();
+        queue_count = 1;
+        queues = std::make_unique<Queue[]>(1);
+    }
+
+    /*!
+    Returns the number of threads doing the work, including the calling one.
+    */
+    size_t thread_count() const { return queue_count; }
+
+    /*!
+    Returns the index of the current thread in [0, thread_count()).
+    Threads that are not workers of this system get 0.
+    */
+    size_t current_thread_index() const {
+        auto &info = this_thread();
+        return info.owner == this ? info.index : 0;
+    }
+
+    /*!
+    Calls `fn(i)` for every `i` in [0, count), split into chunks of `chunk_size` indices.
+    Idle threads steal chunks from the busy ones. Returns when all the chunks are done.
+    */
+    template <typename F>
+    void parallel_for(size_t count, size_t chunk_size, F &&fn) {
+        parallel_for_chunks(count, chunk_size, [&fn](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                fn(i);
+            }
+        });
+    }
+
+    /*!
+    Calls `fn(begin, end)` for every chunk of `chunk_size` indices in [0, count).
+    */
+    template <typename F>
+    void parallel_for_chunks(size_t count, size_t chunk_size, F &&fn) {
+        parallel_for_chunks(count, chunk_size, queue_count, std::forward<F>(fn));
+    }
+
+    /*!
+    Same as above, but the chunks are handed out to at most `max_threads` threads
+    (including the calling one) and only that many workers are woken up.
+    */
+    template <typename F>
+    void parallel_for_chunks(size_t count, size_t chunk_size, size_t max_threads, F &&fn) {
+        if (count == 0) return;
+        chunk_size = std::max<size_t>(chunk_size, 1);
+        size_t task_count = (count + chunk_size - 1) / chunk_size;
+        size_t active = std::min({max_threads, queue_count, task_count});
+
+        if (active <= 1) {
+            fn(0, count);
+            return;
+        }
+
+        using Fn = std::remove_reference_t<F>;
+        Batch batch;
+        batch.run = [](void *context, size_t begin, size_t end) {
+            (*static_cast<Fn *>(context))(begin, end);
+        };
+        batch.context = const_cast<void *>(static_cast<const void *>(std::addressof(fn)));
+        batch.remaining.store(task_count, std::memory_order_relaxed);
+
+        size_t index = current_thread_index();
+
+        // give every active queue a contiguous block of chunks, so neighbours stay on one thread
+        for (size_t k = 0; k < active; ++k) {
+            size_t first = k * task_count / active;
+            size_t last = (k + 1) * task_count / active;
+            if (first == last) continue;
+
+            Queue &queue = queues[(index + k) % queue_count];
+            std::lock_guard<std::mutex> lck(queue.mut);
+            for (size_t t = first; t < last; ++t) {
+                queue.tasks.push_back(
+                    Task{&batch, t * chunk_size, std::min(count, (t + 1) * chunk_size), nullptr}
+                );
+            }
+        }
+        epoch.fetch_add(1, std::memory_order_release);
+        if (active == queue_count) {
+            epoch.notify_all();
+        } else {
+            for (size_t k = 1; k < active; ++k) epoch.notify_one();
+        }
+
+        while (batch.remaining.load(std::memory_order_acquire) != 0) {
+            if (!run_one(index)) std::this_thread::yield();
+        }
+    }
+
+    /*!
+    Queues `fn` to be run by some thread of the system and returns immediately.
+    With no workers the job runs when somebody waits for it.
+    */
+    template <typename F>
+    Handle async(F &&fn) {
+        Handle handle;
+        handle.job = std::make_shared<AsyncJob>();
+        handle.job->fn = std::forward<F>(fn);
+
+        {
+            Queue &queue = queues[current_thread_index()];
+            std::lock_guard<std::mutex> lck(queue.mut);
+            queue.tasks.push_back(Task{nullptr, 0, 0, handle.job});
+        }
+        epoch.fetch_add(1, std::memory_order_release);
+        epoch.notify_all();
+
+        return handle;
+    }
+
+    /*!
+    Returns when the job is done, running other jobs in the meantime.
+    */
+    void wait(const Handle &handle) {
+        size_t index = current_thread_index();
+        while (!handle.is_done()) {
+            if (!run_one(index)) std::this_thread::yield();
+        }
+    }
+
+private:
+    void run_worker(size_t index) {
+        this_thread() = ThreadInfo{this, index};
+        if (on_worker_start) on_worker_start();
+
+        while (true) {
+            std::uint32_t seen = epoch.load(std::memory_order_acquire);
+            if (run_one(index)) continue;
+            if (is_shutting_down) return;
+            epoch.wait(seen, std::memory_order_acquire);
+        }
+    }
+
+    bool pop_own(size_t index, Task &task) {
+        Queue &queue = queues[index];
+        std::lock_guard<std::mutex> lck(queue.mut);
+        if (queue.tasks.empty()) return false;
+        task = queue.tasks.back();
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(size_t index, Task &task) {
+        for (size_t offset = 1; offset < queue_count; ++offset) {
+            Queue &queue = queues[(index + offset) % queue_count];
+            std::lock_guard<std::mutex> lck(queue.mut);
+            if (queue.tasks.empty()) continue;
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    bool run_one(size_t index) {
+        Task task;
+        if (!pop_own(index, task) && !steal(index, task)) return false;
+
+        if (task.async) {
+            task.async->fn();
+            task.async->fn = nullptr;
+            task.async->done.store(true, std::memory_order_release);
+            return true;
+        }
+
+        task.batch->run(task.batch->context, task.begin, task.end);
+        // after this the owner of the batch may return, so the batch must not be touched
+        task.batch->remaining.fetch_sub(1, std::memory_order_acq_rel);
+        return true;
+    }
+};
+
+#endif  // JOB_SYSTEM_HPP
@@ -6,6 +6,11 @@
 #include <atomic>
 #include <SFML/System.hpp>
 #include <boost/serialization/access.hpp>
+#include <boost/serialization/level.hpp>
+#include <boost/serialization/split_free.hpp>
+#include <boost/serialization/vector.hpp>
+
+#include "slot_map.hpp"
 
 namespace boost {
     namespace serialization {
@@ -60,4 +65,34 @@ namespace boost {
     }  // namespace serialization
 }  // namespace boost
 
+namespace boost {
+    namespace serialization {
+        // only the items are saved, exactly as the vector they used to be kept in
+        template <class Archive, typename T, typename Store>
+        void save(Archive &ar, const SlotMap<T, Store> &obj, const unsigned int version) {
+            ar &obj.values();
+        }
+
+        template <class Archive, typename T, typename Store>
+        void load(Archive &ar, SlotMap<T, Store> &obj, const unsigned int version) {
+            std::vector<T> values;
+            ar &values;
+            obj.assign(std::move(values));
+        }
+
+        template <class Archive, typename T, typename Store>
+        void serialize(Archive &ar, SlotMap<T, Store> &t, const unsigned int file_version) {
+            split_free(ar, t, file_version);
+        }
+
+        // no class information of its own, so the old saves still load
+        template <typename T, typename Store>
+        struct implementation_level_impl<const SlotMap<T, Store>> {
+            typedef mpl::integral_c_tag tag;
+            typedef mpl::int_<object_serializable> type;
+            BOOST_STATIC_CONSTANT(int, value = implementation_level_impl::type::value);
+        };
+    }  // namespace serialization
+}  // namespace boost
+
 #endif  // MISSING_SERIALIZERS_H
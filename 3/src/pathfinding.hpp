@@ -0,0 +1,537 @@
+#pragma once
+
+#ifndef PATHFINDING_HPP
+#define PATHFINDING_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "job_system.hpp"
+
+using TileCoords = std::pair<size_t, size_t>;
+using Path = std::vector<TileCoords>;  // from the start to the goal, both included
+
+/*!
+The abstraction of a level for the hierarchical search (HPA*). The level is cut into square
+clusters, the passable openings between the neighbouring clusters become the nodes,
+and the nodes of one cluster are connected with the costs of the ways inside of it.
+A search goes over the nodes first and then refines every step inside of its cluster.
+Never changes after the construction, so any number of threads can search at once.
+*/
+class ClusterGraph {
+public:
+    static constexpr std::uint32_t no_path = std::numeric_limits<std::uint32_t>::max();
+    static constexpr std::uint32_t straight_cost = 10;
+    static constexpr std::uint32_t diagonal_cost = 14;
+
+    /*!
+    `passable` holds one byte per tile, the tile (x, y) is at x * height + y.
+    */
+    ClusterGraph(
+        std::vector<std::uint8_t> passable, size_t width, size_t height, size_t cluster_size
+    )
+        : passable(std::move(passable)),
+          width(width),
+          height(height),
+          cluster_size(std::max<size_t>(cluster_size, 1)) {
+        cluster_columns = (height + this->cluster_size - 1) / this->cluster_size;
+        size_t cluster_rows = (width + this->cluster_size - 1) / this->cluster_size;
+        cluster_nodes.resize(cluster_rows * cluster_columns);
+        add_entrances();
+        connect_clusters();
+    }
+
+    size_t node_count() const { return nodes.size(); }
+
+    bool is_passable(TileCoords tile) const {
+        return tile.first < width && tile.second < height &&
+               passable[tile.first * height + tile.second] != 0;
+    }
+
+    /*!
+    Fills `path` with the tiles from `start` to `goal`, returns false if there is no way.
+    The diagonal steps are not taken past the corners of the impassable tiles.
+    */
+    bool find_path(TileCoords start, TileCoords goal, Path &path) const {
+        path.clear();
+        if (!is_passable(start) || !is_passable(goal)) return false;
+
+        size_t start_cluster = cluster_of(start);
+        size_t goal_cluster = cluster_of(goal);
+        path.push_back(start);
+        if (start_cluster == goal_cluster &&
+            search_local(start, goal, bounds_of(start_cluster), &path) != no_path)
+            return true;
+
+        // the start and the goal are connected to the nodes of their clusters for this search only
+        std::uint32_t start_id = nodes.size();
+        std::uint32_t goal_id = nodes.size() + 1;
+        std::vector<Edge> start_edges;
+        for (std::uint32_t id : cluster_nodes[start_cluster]) {
+            std::uint32_t cost = search_local(start, nodes[id].tile, bounds_of(start_cluster));
+            if (cost != no_path) start_edges.push_back(Edge{id, cost});
+        }
+        std::unordered_map<std::uint32_t, std::uint32_t> goal_costs;
+        for (std::uint32_t id : cluster_nodes[goal_cluster]) {
+            std::uint32_t cost = search_local(nodes[id].tile, goal, bounds_of(goal_cluster));
+            if (cost != no_path) goal_costs[id] = cost;
+        }
+        if (start_edges.empty() || goal_costs.empty()) {
+            path.clear();
+            return false;
+        }
+
+        auto tile_of = [&](std::uint32_t id) {
+            if (id == start_id) return start;
+            if (id == goal_id) return goal;
+            return nodes[id].tile;
+        };
+
+        std::vector<std::uint32_t> costs(nodes.size() + 2, no_path);
+        std::vector<std::uint32_t> parents(nodes.size() + 2, no_path);
+        using Entry = std::pair<std::uint32_t, std::uint32_t>;  // estimate, node
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+        costs[start_id] = 0;
+        open.push({estimate(start, goal), start_id});
+
+        while (!open.empty()) {
+            auto [f, id] = open.top();
+            open.pop();
+            if (id == goal_id) break;
+            if (f > costs[id] + estimate(tile_of(id), goal)) continue;  // an outdated entry
+
+            auto relax = [&](std::uint32_t to, std::uint32_t cost) {
+                if (costs[id] + cost >= costs[to]) return;
+                costs[to] = costs[id] + cost;
+                parents[to] = id;
+                open.push({costs[to] + estimate(tile_of(to), goal), to});
+            };
+            const std::vector<Edge> &edges = id == start_id ? start_edges : nodes[id].edges;
+            for (const Edge &edge : edges) relax(edge.to, edge.cost);
+            if (id != start_id) {
+                auto it = goal_costs.find(id);
+                if (it != goal_costs.end()) relax(goal_id, it->second);
+            }
+        }
+        if (costs[goal_id] == no_path) {
+            path.clear();
+            return false;
+        }
+
+        std::vector<std::uint32_t> waypoints;
+        for (std::uint32_t id = goal_id; id != no_path; id = parents[id]) waypoints.push_back(id);
+        std::reverse(waypoints.begin(), waypoints.end());
+
+        // the nodes of different clusters are next to each other, the rest is searched again
+        for (size_t i = 1; i < waypoints.size(); ++i) {
+            TileCoords from = tile_of(waypoints[i - 1]);
+            TileCoords to = tile_of(waypoints[i]);
+            if (cluster_of(from) != cluster_of(to)) {
+                path.push_back(to);
+            } else {
+                search_local(from, to, bounds_of(cluster_of(from)), &path);
+            }
+        }
+        return true;
+    }
+
+private:
+    struct Edge {
+        std::uint32_t to;
+        std::uint32_t cost;
+    };
+
+    struct Node {
+        TileCoords tile;
+        std::vector<Edge> edges;
+    };
+
+    struct Bounds {
+        size_t left, top, right, bottom;  // [left, right) by x and [top, bottom) by y
+    };
+
+    // the orthogonal steps go first, so they are preferred over the diagonal ones
+    static constexpr std::pair<int, int> steps[8] = {
+        {1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {1, -1}, {-1, 1}, {-1, -1},
+    };
+
+    std::vector<std::uint8_t> passable;
+    size_t width;
+    size_t height;
+    size_t cluster_size;
+    size_t cluster_columns;
+    std::vector<Node> nodes;
+    std::vector<std::vector<std::uint32_t>> cluster_nodes;
+    std::unordered_map<size_t, std::uint32_t> node_of_tile;
+
+    size_t cluster_of(TileCoords tile) const {
+        return tile.first / cluster_size * cluster_columns + tile.second / cluster_size;
+    }
+
+    Bounds bounds_of(size_t cluster) const {
+        size_t left = cluster / cluster_columns * cluster_size;
+        size_t top = cluster % cluster_columns * cluster_size;
+        return Bounds{
+            left, top, std::min(left + cluster_size, width), std::min(top + cluster_size, height)
+        };
+    }
+
+    /*!
+    The octile distance, exact when nothing is in the way.
+    */
+    static std::uint32_t estimate(TileCoords from, TileCoords to) {
+        size_t dx = from.first > to.first ? from.first - to.first : to.first - from.first;
+        size_t dy = from.second > to.second ? from.second - to.second : to.second - from.second;
+        return straight_cost * std::max(dx, dy) +
+               (diagonal_cost - straight_cost) * std::min(dx, dy);
+    }
+
+    /*!
+    A* over the tiles inside of `bounds`. Returns the cost of the way, `no_path` if there is none.
+    If `path` is given, the tiles after `from` are appended to it.
+    */
+    std::uint32_t search_local(
+        TileCoords from, TileCoords to, Bounds bounds, Path *path = nullptr
+    ) const {
+        size_t local_height = bounds.bottom - bounds.top;
+        auto index_of = [&](size_t x, size_t y) {
+            return (x - bounds.left) * local_height + (y - bounds.top);
+        };
+        size_t area = (bounds.right - bounds.left) * local_height;
+
+        std::vector<std::uint32_t> costs(area, no_path);
+        std::vector<std::uint32_t> parents(area, no_path);
+        using Entry = std::pair<std::uint32_t, std::uint32_t>;  // estimate, local index
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+
+        size_t goal = index_of(to.first, to.second);
+        costs[index_of(from.first, from.second)] = 0;
+        open.push({estimate(from, to), index_of(from.first, from.second)});
+
+        auto inside = [&](size_t x, size_t y) {
+            return x >= bounds.left && x < bounds.right && y >= bounds.top && y < bounds.bottom &&
+                   passable[x * height + y] != 0;
+        };
+
+        while (!open.empty()) {
+            auto [f, current] = open.top();
+            open.pop();
+            if (current == goal) break;
+
+            size_t x = bounds.left + current / local_height;
+            size_t y = bounds.top + current % local_height;
+            if (f > costs[current] + estimate({x, y}, to)) continue;  // an outdated entry
+
+            for (auto [dx, dy] : steps) {
+                size_t nx = x + dx;  // wraps around below zero and fails the bounds check
+                size_t ny = y + dy;
+                if (!inside(nx, ny)) continue;
+                bool is_diagonal = dx != 0 && dy != 0;
+                if (is_diagonal && (!inside(nx, y) || !inside(x, ny))) continue;
+
+                std::uint32_t cost = costs[current] + (is_diagonal ? diagonal_cost : straight_cost);
+                size_t next = index_of(nx, ny);
+                if (cost >= costs[next]) continue;
+                costs[next] = cost;
+                parents[next] = current;
+                open.push({cost + estimate({nx, ny}, to), next});
+            }
+        }
+        if (costs[goal] == no_path) return no_path;
+
+        if (path) {
+            size_t begin = path->size();
+            for (size_t i = goal; i != index_of(from.first, from.second); i = parents[i]) {
+                path->emplace_back(bounds.left + i / local_height, bounds.top + i % local_height);
+            }
+            std::reverse(path->begin() + begin, path->end());
+        }
+        return costs[goal];
+    }
+
+    std::uint32_t node_at(TileCoords tile) {
+        auto [it, is_new] = node_of_tile.emplace(tile.first * height + tile.second, nodes.size());
+        if (is_new) {
+            nodes.push_back(Node{tile, {}});
+            cluster_nodes[cluster_of(tile)].push_back(it->second);
+        }
+        return it->second;
+    }
+
+    void connect(TileCoords a, TileCoords b, std::uint32_t cost) {
+        std::uint32_t from = node_at(a);
+        std::uint32_t to = node_at(b);
+        nodes[from].edges.push_back(Edge{to, cost});
+        nodes[to].edges.push_back(Edge{from, cost});
+    }
+
+    /*!
+    Every run of the passable tiles along the side shared by two clusters is one entrance,
+    the short ones get a node pair in the middle and the long ones at both ends.
+    */
+    void add_entrances() {
+        auto add_runs = [&](size_t length, auto &&tile_pair) {
+            size_t begin = 0;
+            while (begin < length) {
+                auto [a, b] = tile_pair(begin);
+                if (!is_passable(a) || !is_passable(b)) {
+                    ++begin;
+                    continue;
+                }
+                // the runs do not go past the corners of the clusters
+                size_t end = begin;
+                size_t corner = (begin / cluster_size + 1) * cluster_size;
+                while (end < std::min(length, corner)) {
+                    auto [c, d] = tile_pair(end);
+                    if (!is_passable(c) || !is_passable(d)) break;
+                    ++end;
+                }
+
+                if (end - begin < long_entrance) {
+                    auto [c, d] = tile_pair(begin + (end - begin) / 2);
+                    connect(c, d, straight_cost);
+                } else {
+                    auto [c, d] = tile_pair(begin);
+                    connect(c, d, straight_cost);
+                    auto [e, f] = tile_pair(end - 1);
+                    connect(e, f, straight_cost);
+                }
+                begin = end;
+            }
+        };
+
+        for (size_t x = cluster_size; x < width; x += cluster_size) {
+            add_runs(height, [&](size_t y) {
+                return std::make_pair(TileCoords(x - 1, y), TileCoords(x, y));
+            });
+        }
+        for (size_t y = cluster_size; y < height; y += cluster_size) {
+            add_runs(width, [&](size_t x) {
+                return std::make_pair(TileCoords(x, y - 1), TileCoords(x, y));
+            });
+        }
+    }
+
+    void connect_clusters() {
+        for (size_t cluster = 0; cluster < cluster_nodes.size(); ++cluster) {
+            const std::vector<std::uint32_t> &ids = cluster_nodes[cluster];
+            for (size_t i = 0; i < ids.size(); ++i) {
+                for (size_t j = i + 1; j < ids.size(); ++j) {
+                    std::uint32_t cost =
+                        search_local(nodes[ids[i]].tile, nodes[ids[j]].tile, bounds_of(cluster));
+                    if (cost == no_path) continue;
+                    nodes[ids[i]].edges.push_back(Edge{ids[j], cost});
+                    nodes[ids[j]].edges.push_back(Edge{ids[i], cost});
+                }
+            }
+        }
+    }
+
+    static constexpr size_t long_entrance = 6;
+};
+
+/*!
+The most recently used paths, shared by all the actors of a level.
+*/
+class PathCache {
+public:
+    size_t capacity = 512;
+
+    std::shared_ptr<const Path> get(TileCoords start, TileCoords goal) {
+        std::lock_guard<std::mutex> lck(mut);
+        auto it = index.find(key_of(start, goal));
+        if (it == index.end()) return nullptr;
+        entries.splice(entries.begin(), entries, it->second);
+        return it->second->second;
+    }
+
+    void put(TileCoords start, TileCoords goal, std::shared_ptr<const Path> path) {
+        std::lock_guard<std::mutex> lck(mut);
+        std::uint64_t key = key_of(start, goal);
+        auto it = index.find(key);
+        if (it != index.end()) {
+            it->second->second = std::move(path);
+            entries.splice(entries.begin(), entries, it->second);
+            return;
+        }
+        entries.emplace_front(key, std::move(path));
+        index[key] = entries.begin();
+        while (entries.size() > capacity) {
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lck(mut);
+        return entries.size();
+    }
+
+private:
+    using Entries = std::list<std::pair<std::uint64_t, std::shared_ptr<const Path>>>;
+
+    mutable std::mutex mut;
+    Entries entries;  // the most recently used first
+    std::unordered_map<std::uint64_t, Entries::iterator> index;
+
+    static std::uint64_t key_of(TileCoords start, TileCoords goal) {
+        return (std::uint64_t)(start.first & 0xffff) << 48 |
+               (std::uint64_t)(start.second & 0xffff) << 32 |
+               (std::uint64_t)(goal.first & 0xffff) << 16 | (std::uint64_t)(goal.second & 0xffff);
+    }
+};
+
+/*!
+A path asked for by an actor, filled in by a worker some time later.
+*/
+class PathRequest {
+public:
+    TileCoords start;
+    TileCoords goal;
+    std::shared_ptr<const Path> path;  // empty when the goal can not be reached
+
+    bool is_done() const { return done.load(std::memory_order_acquire); }
+
+private:
+    friend class PathService;
+
+    std::atomic<bool> done = false;
+};
+
+/*!
+Finds the paths for all the actors of a level. The requests can be made from any thread,
+they are collected and resolved by the workers of the job system after `dispatch`,
+and the cached ones are resolved at once. A copy of the service starts with its own
+cache and requests, only the graph is shared, since it never changes.
+*/
+class PathService {
+public:
+    size_t cluster_size = 8;
+    size_t requests_per_job = 16;
+
+    PathService() = default;
+    PathService(const PathService &other)
+        : cluster_size(other.cluster_size),
+          requests_per_job(other.requests_per_job),
+          graph(other.graph) {
+        state->cache.capacity = other.state->cache.capacity;
+    }
+    PathService &operator=(const PathService &other) {
+        cluster_size = other.cluster_size;
+        requests_per_job = other.requests_per_job;
+        graph = other.graph;
+        state = std::make_shared<State>();
+        state->cache.capacity = other.state->cache.capacity;
+        return *this;
+    }
+
+    bool has_graph() const { return (bool)graph; }
+    const ClusterGraph *get_graph() const { return graph.get(); }
+    PathCache &get_cache() { return state->cache; }
+
+    /*!
+    Builds the graph of the tiles, see `ClusterGraph`. The requests in flight finish
+    on the old graph, the cache starts from scratch.
+    */
+    void rebuild(std::vector<std::uint8_t> passable, size_t width, size_t height) {
+        graph = std::make_shared<const ClusterGraph>(
+            std::move(passable), width, height, cluster_size
+        );
+
+        auto fresh = std::make_shared<State>();
+        fresh->cache.capacity = state->cache.capacity;
+        {
+            std::lock_guard<std::mutex> lck(state->mut);
+            fresh->pending = std::move(state->pending);
+        }
+        state = fresh;
+    }
+
+    /*!
+    Drops the graph, it is rebuilt before the next dispatch.
+    */
+    void invalidate() { graph.reset(); }
+
+    std::shared_ptr<const PathRequest> request(TileCoords start, TileCoords goal) {
+        auto request = std::make_shared<PathRequest>();
+        request->start = start;
+        request->goal = goal;
+        if (auto path = state->cache.get(start, goal); path) {
+            request->path = path;
+            request->done.store(true, std::memory_order_release);
+            return request;
+        }
+
+        std::lock_guard<std::mutex> lck(state->mut);
+        state->pending.push_back(request);
+        return request;
+    }
+
+    /*!
+    Gives the collected requests to the workers. Runs them right away without any workers.
+    */
+    void dispatch(JobSystem &jobs) {
+        if (!graph) return;
+        std::erase_if(in_flight, [](const JobSystem::Handle &it) { return it.is_done(); });
+
+        std::vector<std::shared_ptr<PathRequest>> pending;
+        {
+            std::lock_guard<std::mutex> lck(state->mut);
+            pending.swap(state->pending);
+        }
+
+        size_t step = std::max<size_t>(requests_per_job, 1);
+        for (size_t begin = 0; begin < pending.size(); begin += step) {
+            std::vector<std::shared_ptr<PathRequest>> batch(
+                pending.begin() + begin, pending.begin() + std::min(begin + step, pending.size())
+            );
+            auto job = [graph = graph, state = state, batch = std::move(batch)]() {
+                for (auto &it : batch) resolve(*graph, state->cache, *it);
+            };
+            in_flight.push_back(jobs.async(std::move(job)));
+        }
+        if (jobs.thread_count() <= 1) wait(jobs);
+    }
+
+    void wait(JobSystem &jobs) {
+        for (auto &it : in_flight) jobs.wait(it);
+        in_flight.clear();
+    }
+
+private:
+    struct State {
+        std::mutex mut;
+        std::vector<std::shared_ptr<PathRequest>> pending;
+        PathCache cache;
+    };
+
+    std::shared_ptr<const ClusterGraph> graph;
+    std::shared_ptr<State> state = std::make_shared<State>();
+    std::vector<JobSystem::Handle> in_flight;
+
+    static void resolve(const ClusterGraph &graph, PathCache &cache, PathRequest &request) {
+        // an earlier request of the same batch could have found it already
+        std::shared_ptr<const Path> path = cache.get(request.start, request.goal);
+        if (!path) {
+            auto found = std::make_shared<Path>();
+            graph.find_path(request.start, request.goal, *found);
+            cache.put(request.start, request.goal, found);
+            path = found;
+        }
+        request.path = path;
+        request.done.store(true, std::memory_order_release);
+    }
+};
+
+#endif  // PATHFINDING_HPP
@@ -0,0 +1,330 @@
+#pragma once
+
+#ifndef SLOT_MAP_HPP
+#define SLOT_MAP_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "compaction.hpp"
+#include "job_system.hpp"
+
+/*!
+Refers to an item of a `SlotMap`. Stays valid while the item is moved around inside
+of the map, and stops referring to anything once the item is removed,
+even if its slot is reused by another item later.
+*/
+class SlotHandle {
+public:
+    static constexpr std::uint32_t no_slot = std::numeric_limits<std::uint32_t>::max();
+
+    std::uint32_t slot = no_slot;
+    std::uint32_t generation = 0;
+
+    bool operator==(const SlotHandle &other) const = default;
+    bool operator!=(const SlotHandle &other) const = default;
+};
+
+/*!
+The default store of a `SlotMap`, it holds nothing.
+*/
+class NoStore {};
+
+/*!
+The items are stored densely and can be iterated and indexed like a vector, their order
+can change with `reorder`, `compact` and `erase`. The slots give every item a stable
+handle, with a generation that is bumped every time the slot is freed.
+The lookup, the insertion and the removal by a handle are all O(1).
+
+A `Store` keeps some data of the items outside of them, one row per item, in the same order.
+Every item is bound to its row with `bind(store, row)`, which moves the data there,
+and `rebind(store, row)` only points it to the row that already holds its data.
+The items move their data themselves when they are assigned to each other,
+so the rows follow the items through `reorder`, `compact` and `erase`.
+*/
+template <typename T, typename Store = NoStore>
+class SlotMap {
+public:
+    using value_type = T;
+    using iterator = typename std::vector<T>::iterator;
+    using const_iterator = typename std::vector<T>::const_iterator;
+
+    SlotMap() = default;
+    SlotMap(const SlotMap &other) { *this = other; }
+    SlotMap(SlotMap &&other) { *this = std::move(other); }
+
+    // the copied items are not bound to any rows, so they are bound to the new ones
+    SlotMap &operator=(const SlotMap &other) {
+        if (this == &other) return *this;
+        items.clear();
+        items = other.items;
+        slot_of = other.slot_of;
+        slots = other.slots;
+        first_free = other.first_free;
+        if constexpr (has_store) {
+            store = Store();
+            store.resize(items.size());
+            for (size_t i = 0; i < items.size(); ++i) items[i].bind(&store, i);
+        }
+        return *this;
+    }
+
+    // the items keep their rows, only the store is at another address now
+    SlotMap &operator=(SlotMap &&other) {
+        if (this == &other) return *this;
+        items = std::move(other.items);
+        slot_of = std::move(other.slot_of);
+        slots = std::move(other.slots);
+        first_free = std::exchange(other.first_free, SlotHandle::no_slot);
+        if constexpr (has_store) {
+            store = std::move(other.store);
+            rebind(0, items.size());
+            other.items.clear();
+            other.store = Store();
+        }
+        return *this;
+    }
+
+    size_t size() const { return items.size(); }
+    bool empty() const { return items.empty(); }
+
+    T &operator[](size_t index) { return items[index]; }
+    const T &operator[](size_t index) const { return items[index]; }
+    T &back() { return items.back(); }
+    const T &back() const { return items.back(); }
+
+    iterator begin() { return items.begin(); }
+    iterator end() { return items.end(); }
+    const_iterator begin() const { return items.begin(); }
+    const_iterator end() const { return items.end(); }
+
+    /*!
+    The items in their current order, the same as the indices.
+    */
+    const std::vector<T> &values() const { return items; }
+
+    /*!
+    The rows of the items, see `Store`.
+    */
+    Store &get_store() { return store; }
+    const Store &get_store() const { return store; }
+
+    void reserve(size_t count) {
+        const T *old = items.data();
+        items.reserve(count);
+        slot_of.reserve(count);
+        if (items.data() != old) rebind(0, items.size());
+    }
+
+    SlotHandle insert(T item) {
+        const T *old = items.data();
+        items.push_back(std::move(item));
+        added(old);
+        return allocate(items.size() - 1);
+    }
+
+    void push_back(T item) { insert(std::move(item)); }
+
+    template <typename... Args>
+    T &emplace_back(Args &&...args) {
+        const T *old = items.data();
+        items.emplace_back(std::forward<Args>(args)...);
+        added(old);
+        allocate(items.size() - 1);
+        return items.back();
+    }
+
+    /*!
+    Returns the handle of the item at the `index`.
+    */
+    SlotHandle handle_of(size_t index) const {
+        return SlotHandle{slot_of[index], slots[slot_of[index]].generation};
+    }
+
+    bool contains(SlotHandle handle) const {
+        return handle.slot < slots.size() && slots[handle.slot].generation == handle.generation &&
+               slots[handle.slot].is_used;
+    }
+
+    /*!
+    Returns the index of the item, or `size()` if the handle is stale.
+    */
+    size_t index_of(SlotHandle handle) const {
+        return contains(handle) ? slots[handle.slot].index : items.size();
+    }
+
+    T *get(SlotHandle handle) {
+        return contains(handle) ? &items[slots[handle.slot].index] : nullptr;
+    }
+
+    const T *get(SlotHandle handle) const {
+        return contains(handle) ? &items[slots[handle.slot].index] : nullptr;
+    }
+
+    /*!
+    Removes the item by moving the last one into its place. Returns false if the handle is stale.
+    */
+    bool erase(SlotHandle handle) {
+        if (!contains(handle)) return false;
+        size_t index = slots[handle.slot].index;
+        size_t last = items.size() - 1;
+        if (index != last) {
+            items[index] = std::move(items[last]);
+            slot_of[index] = slot_of[last];
+            slots[slot_of[index]].index = index;
+        }
+        items.pop_back();
+        slot_of.pop_back();
+        if constexpr (has_store) store.resize(items.size());
+        release(handle.slot);
+        return true;
+    }
+
+    void clear() {
+        for (std::uint32_t slot : slot_of) release(slot);
+        items.clear();
+        slot_of.clear();
+        if constexpr (has_store) store.resize(0);
+    }
+
+    /*!
+    Replaces all the items, the old handles become stale.
+    */
+    void assign(std::vector<T> values) {
+        clear();
+        items = std::move(values);
+        for (size_t i = 0; i < items.size(); ++i) allocate(i);
+        if constexpr (has_store) {
+            store.resize(items.size());
+            for (size_t i = 0; i < items.size(); ++i) items[i].bind(&store, i);
+        }
+    }
+
+    /*!
+    Moves the item at index `sources[i - first]` to the index i, for every i from `first` on.
+    The sources must be a permutation of these indices, the items before `first` stay.
+    Only the items that change their index are moved, once each, by following
+    the cycles of the permutation. The sources are left as the identity.
+    The handles keep referring to the same items.
+    */
+    void reorder(std::vector<std::uint32_t> &sources, size_t first = 0) {
+        for (size_t start = first; start < items.size(); ++start) {
+            if (sources[start - first] == start) continue;
+
+            T carried = std::move(items[start]);
+            std::uint32_t carried_slot = slot_of[start];
+            size_t to = start;
+            while (sources[to - first] != start) {
+                size_t from = sources[to - first];
+                items[to] = std::move(items[from]);
+                place(to, slot_of[from]);
+                sources[to - first] = to;
+                to = from;
+            }
+            items[to] = std::move(carried);
+            place(to, carried_slot);
+            sources[to - first] = to;
+        }
+    }
+
+    /*!
+    Same as `parallel_compact` of a vector, the handles of the removed items become stale.
+    The items and their slots are moved together in one pass, only the survivors
+    after the first removed item are touched. The items before `first` are not looked at.
+    */
+    template <typename IsRemoved, typename OnRemoved>
+    size_t compact(
+        JobSystem &jobs, size_t chunk_size, IsRemoved is_removed, OnRemoved on_removed,
+        size_t first = 0
+    ) {
+        plan_compaction(jobs, items, chunk_size, is_removed, on_removed, plan, first);
+        if (plan.removed() == 0) return 0;
+
+        for (size_t i = 0; i < plan.keep.size(); ++i) {
+            if (!plan.keep[i]) release(slot_of[plan.first + i]);
+        }
+        plan.for_each_move([&](size_t from, size_t to) {
+            items[to] = std::move(items[from]);
+            place(to, slot_of[from]);
+        });
+        items.erase(items.begin() + plan.kept(), items.end());
+        slot_of.resize(plan.kept());
+        if constexpr (has_store) store.resize(items.size());
+        return plan.removed();
+    }
+
+private:
+    static constexpr bool has_store = !std::is_same_v<Store, NoStore>;
+
+    struct Slot {
+        std::uint32_t index;  // of the item if the slot is used, of the next free slot otherwise
+        std::uint32_t generation;
+        bool is_used;
+    };
+
+    std::vector<T> items;
+    std::vector<std::uint32_t> slot_of;  // follows the items
+    std::vector<Slot> slots;
+    std::uint32_t first_free = SlotHandle::no_slot;
+    CompactionPlan plan;  // of the last `compact`, kept for its arrays
+    [[no_unique_address]] Store store;
+
+    /*!
+    Gives the last item its row. If the items were moved to another buffer,
+    they are pointed back to their rows, which still hold their data.
+    */
+    void added(const T *old) {
+        if constexpr (has_store) {
+            size_t last = items.size() - 1;
+            store.resize(items.size());
+            if (items.data() != old) rebind(0, last);
+            items[last].bind(&store, last);
+        }
+    }
+
+    void rebind(size_t begin, size_t end) {
+        if constexpr (has_store) {
+            for (size_t i = begin; i < end; ++i) items[i].rebind(&store, i);
+        }
+    }
+
+    SlotHandle allocate(size_t index) {
+        std::uint32_t slot = first_free;
+        if (slot == SlotHandle::no_slot) {
+            slot = slots.size();
+            slots.push_back(Slot{0, 0, false});
+        } else {
+            first_free = slots[slot].index;
+        }
+        slots[slot].index = index;
+        slots[slot].is_used = true;
+        slot_of.push_back(slot);
+        return SlotHandle{slot, slots[slot].generation};
+    }
+
+    void place(size_t index, std::uint32_t slot) {
+        slot_of[index] = slot;
+        slots[slot].index = index;
+    }
+
+    void release(std::uint32_t slot) {
+        slots[slot].is_used = false;
+        ++slots[slot].generation;
+        slots[slot].index = first_free;
+        first_free = slot;
+    }
+};
+
+template <typename T, typename Store, typename IsRemoved, typename OnRemoved>
+size_t parallel_compact(
+    JobSystem &jobs, SlotMap<T, Store> &items, size_t chunk_size, IsRemoved is_removed,
+    OnRemoved on_removed, size_t first = 0
+) {
+    return items.compact(jobs, chunk_size, is_removed, on_removed, first);
+}
+
+#endif  // SLOT_MAP_HPP
@@ -0,0 +1,142 @@
+#pragma once
+
+#ifndef UNIFORM_GRID_HPP
+#define UNIFORM_GRID_HPP
+
+#include <SFML/Graphics/Rect.hpp>
+#include <SFML/System/Vector2.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*!
+Buckets item indices by the grid cell their position falls into.
+Positions outside of the grid are clamped to the border cells,
+so the neighbourhood queries never miss an item.
+*/
+class UniformGrid {
+private:
+    float cell_size = 1.0f;
+    size_t columns = 0;  // along x
+    size_t rows = 0;     // along y
+
+    std::vector<std::vector<std::uint32_t>> cells;
+    std::vector<std::uint32_t> item_cells;  // the cell of every item
+
+public:
+    /*!
+    Resizes the grid to cover [0, columns * cell_size) x [0, rows * cell_size).
+    Does nothing if the layout is the same, otherwise drops all the items.
+    */
+    void resize(size_t columns, size_t rows, float cell_size) {
+        columns = std::max<size_t>(columns, 1);
+        rows = std::max<size_t>(rows, 1);
+        if (columns == this->columns && rows == this->rows && cell_size == this->cell_size) return;
+
+        this->columns = columns;
+        this->rows = rows;
+        this->cell_size = cell_size;
+        cells.assign(columns * rows, {});
+        item_cells.clear();
+    }
+
+    /*!
+    Returns the number of items in the grid.
+    */
+    size_t size() const { return item_cells.size(); }
+
+    /*!
+    Returns the side of a cell.
+    */
+    float get_cell_size() const { return cell_size; }
+
+    /*!
+    Returns the cell coordinates of the position, clamped to the grid.
+    */
+    std::pair<size_t, size_t> cell_coords_of(sf::Vector2f position) const {
+        return {clamp_axis(position.x, columns), clamp_axis(position.y, rows)};
+    }
+
+    /*!
+    Moves every item whose cell changed since the last update into its new cell.
+    `position(i)` returns the position of the i-th item.
+    If the number of items changed, the grid is rebuilt from scratch.
+    */
+    template <typename GetPosition>
+    void update(size_t count, GetPosition position) {
+        if (count != item_cells.size()) {
+            for (auto &cell : cells) cell.clear();
+            item_cells.resize(count);
+            for (size_t i = 0; i < count; ++i) {
+                item_cells[i] = cell_of(position(i));
+                cells[item_cells[i]].push_back(i);
+            }
+            return;
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            std::uint32_t cell = cell_of(position(i));
+            if (cell == item_cells[i]) continue;
+
+            auto &old_cell = cells[item_cells[i]];
+            auto it = std::find(old_cell.begin(), old_cell.end(), i);
+            *it = old_cell.back();
+            old_cell.pop_back();
+
+            cells[cell].push_back(i);
+            item_cells[i] = cell;
+        }
+    }
+
+    /*!
+    Calls `fn(index)` for every item in the cells that are at most `reach` cells
+    away (on each axis) from the cell of the position.
+    */
+    template <typename F>
+    void for_each_near(sf::Vector2f position, size_t reach, F fn) const {
+        auto [x, y] = cell_coords_of(position);
+        size_t x0 = x > reach ? x - reach : 0;
+        size_t y0 = y > reach ? y - reach : 0;
+        size_t x1 = std::min(columns - 1, x + reach);
+        size_t y1 = std::min(rows - 1, y + reach);
+        for_each_in_cells(x0, y0, x1, y1, fn);
+    }
+
+    /*!
+    Calls `fn(index)` for every item in the cells overlapping the rectangle.
+    */
+    template <typename F>
+    void for_each_in_rect(const sf::FloatRect &rect, F fn) const {
+        auto [x0, y0] = cell_coords_of({rect.left, rect.top});
+        auto [x1, y1] = cell_coords_of({rect.left + rect.width, rect.top + rect.height});
+        for_each_in_cells(x0, y0, x1, y1, fn);
+    }
+
+private:
+    size_t clamp_axis(float value, size_t count) const {
+        float cell = std::floor(value / cell_size);
+        if (!(cell > 0)) return 0;  // also catches NaN
+        return std::min(count - 1, (size_t)cell);
+    }
+
+    std::uint32_t cell_of(sf::Vector2f position) const {
+        auto [x, y] = cell_coords_of(position);
+        return y * columns + x;
+    }
+
+    template <typename F>
+    void for_each_in_cells(size_t x0, size_t y0, size_t x1, size_t y1, F &fn) const {
+        if (cells.empty()) return;
+        for (size_t y = y0; y <= y1; ++y) {
+            for (size_t x = x0; x <= x1; ++x) {
+                for (std::uint32_t index : cells[y * columns + x]) {
+                    fn(index);
+                }
+            }
+        }
+    }
+};
+
+#endif  // UNIFORM_GRID_HPP
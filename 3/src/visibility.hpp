@@ -0,0 +1,150 @@
+#pragma once
+
+#ifndef VISIBILITY_HPP
+#define VISIBILITY_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/*!
+One bit per tile, set for the tiles that block the sight.
+The tile (x, y) is bit x * height + y, same as in the other per tile arrays.
+*/
+class SolidTileMap {
+public:
+    /*!
+    `passable` holds one byte per tile, every tile that is not passable is solid.
+    */
+    void build(const std::vector<std::uint8_t> &passable, size_t width, size_t height) {
+        this->width = width;
+        this->height = height;
+        bits.assign((width * height + 63) / 64, 0);
+        for (size_t i = 0; i < width * height; ++i) {
+            if (!passable[i]) bits[i / 64] |= (std::uint64_t)1 << (i % 64);
+        }
+        is_built = true;
+    }
+
+    void clear() {
+        width = height = 0;
+        bits.clear();
+        is_built = false;
+    }
+
+    bool has_been_built() const { return is_built; }
+    size_t get_width() const { return width; }
+    size_t get_height() const { return height; }
+
+    /*!
+    The tiles outside of the map are solid.
+    */
+    bool is_solid(long x, long y) const {
+        if (x < 0 || y < 0 || (size_t)x >= width || (size_t)y >= height) return true;
+        size_t i = (size_t)x * height + (size_t)y;
+        return (bits[i / 64] >> (i % 64)) & 1;
+    }
+
+    /*!
+    Walks the Bresenham line between the tiles. The sight is blocked by any solid tile
+    on the way, the target included, but not by the tile it is looked from.
+    */
+    bool has_line_of_sight(std::pair<size_t, size_t> from, std::pair<size_t, size_t> to) const {
+        long x = from.first, y = from.second;
+        long end_x = to.first, end_y = to.second;
+        long dx = std::labs(end_x - x), step_x = x < end_x ? 1 : -1;
+        long dy = -std::labs(end_y - y), step_y = y < end_y ? 1 : -1;
+        long error = dx + dy;
+
+        while (x != end_x || y != end_y) {
+            long doubled = 2 * error;
+            if (doubled >= dy) {
+                error += dy;
+                x += step_x;
+            }
+            if (doubled <= dx) {
+                error += dx;
+                y += step_y;
+            }
+            if (is_solid(x, y)) return false;
+        }
+        return true;
+    }
+
+private:
+    size_t width = 0;
+    size_t height = 0;
+    std::vector<std::uint64_t> bits;
+    bool is_built = false;
+};
+
+/*!
+Remembers which tiles see the target tile, so the enemies standing on the same tile
+share one check, and the checks are not repeated while the target stays on its tile.
+Every entry holds the stamp of the target it was computed for, so changing the target
+forgets everything at once. Any number of threads can check at the same time.
+*/
+class VisibilityCache {
+public:
+    VisibilityCache() = default;
+    // the results are cheap to get again, so they are never copied
+    VisibilityCache(const VisibilityCache &) {}
+    VisibilityCache &operator=(const VisibilityCache &) {
+        entries.reset();
+        size = 0;
+        return *this;
+    }
+
+    size_t get_size() const { return size; }
+
+    void resize(size_t tile_count) {
+        entries = std::make_unique<std::atomic<std::uint32_t>[]>(tile_count);
+        size = tile_count;
+        stamp = 1;
+    }
+
+    /*!
+    Starts checking against `target`, forgets the results if it is another tile.
+    Must not be called during the checks.
+    */
+    void set_target(std::pair<size_t, size_t> target) {
+        if (has_target && this->target == target) return;
+        this->target = target;
+        has_target = true;
+        forget();
+    }
+
+    void forget() {
+        if (++stamp < max_stamp) return;
+        for (size_t i = 0; i < size; ++i) entries[i].store(0, std::memory_order_relaxed);
+        stamp = 1;
+    }
+
+    bool sees_target(const SolidTileMap &map, std::pair<size_t, size_t> from) {
+        size_t i = from.first * map.get_height() + from.second;
+        if (i >= size) return map.has_line_of_sight(from, target);
+
+        std::uint32_t entry = entries[i].load(std::memory_order_relaxed);
+        if (entry >> 1 == stamp) return entry & 1;
+
+        // other threads can only store the same result here
+        bool is_visible = map.has_line_of_sight(from, target);
+        entries[i].store(stamp << 1 | (std::uint32_t)is_visible, std::memory_order_relaxed);
+        return is_visible;
+    }
+
+private:
+    static constexpr std::uint32_t max_stamp = (std::uint32_t)1 << 31;
+
+    std::unique_ptr<std::atomic<std::uint32_t>[]> entries;
+    size_t size = 0;
+    std::uint32_t stamp = 1;
+    std::pair<size_t, size_t> target;
+    bool has_target = false;
+};
+
+#endif  // VISIBILITY_HPP
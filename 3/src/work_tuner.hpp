@@ -0,0 +1,151 @@
+#pragma once
+
+#ifndef WORK_TUNER_HPP
+#define WORK_TUNER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "job_system.hpp"
+
+/*!
+Limits of the work tuner, read from the `[threads]` table of the config.
+*/
+struct WorkLimits {
+    size_t max_threads = 0;         // 0 means all the threads of the job system
+    double serial_below_us = 50.0;  // smaller loops are run on the calling thread
+    double chunk_us = 20.0;         // the amount of work one chunk should carry
+    size_t chunks_per_thread = 4;   // leaves some chunks to be stolen
+};
+
+/*!
+Chooses the number of threads and the chunk size of a parallel loop
+from the measured cost of one item, so that small loops do not wake the workers up.
+*/
+class WorkTuner {
+public:
+    struct Plan {
+        size_t threads;
+        size_t chunk_size;
+    };
+
+    WorkLimits limits;
+
+    /*!
+    Returns the plan for `count` items, when `available_threads` threads can do the work.
+    */
+    Plan plan(size_t count, size_t available_threads) const {
+        if (count == 0) return Plan{1, 1};
+
+        double cost_ns = cost_per_item_ns > 0.0 ? cost_per_item_ns : initial_cost_ns;
+        double total_us = cost_ns * (double)count / 1000.0;
+
+        size_t max_threads = std::max<size_t>(available_threads, 1);
+        if (limits.max_threads != 0) max_threads = std::min(max_threads, limits.max_threads);
+
+        // every thread should get at least as much work as is worth waking it up for
+        size_t threads = max_threads;
+        if (limits.serial_below_us > 0.0) {
+            double worth = std::floor(total_us / limits.serial_below_us);
+            if (worth < (double)threads) threads = (size_t)worth;
+        }
+        threads = std::min(threads, count);
+        if (threads <= 1) return Plan{1, count};
+
+        double chunk = std::round(limits.chunk_us * 1000.0 / cost_ns);
+        size_t chunk_size = chunk < 1.0 ? 1 : (size_t)std::min<double>(chunk, (double)count);
+        size_t chunks = threads * std::max<size_t>(limits.chunks_per_thread, 1);
+        chunk_size = std::min(chunk_size, (count + chunks - 1) / chunks);
+        return Plan{threads, std::max<size_t>(chunk_size, 1)};
+    }
+
+    /*!
+    Adds the measurement of `count` items that took `busy` of thread time in total.
+    */
+    void record(size_t count, std::chrono::nanoseconds busy) {
+        if (count == 0) return;
+        double cost_ns = (double)busy.count() / (double)count;
+        if (cost_per_item_ns <= 0.0) {
+            cost_per_item_ns = cost_ns;
+        } else {
+            cost_per_item_ns += (cost_ns - cost_per_item_ns) * smoothing;
+        }
+    }
+
+    /*!
+    Returns the estimated cost of one item in nanoseconds, 0 if nothing was measured yet.
+    */
+    double get_cost_per_item_ns() const { return cost_per_item_ns; }
+
+    /*!
+    Calls `fn(i)` for every `i` in [0, count) according to the plan and measures the loop.
+    */
+    template <typename F>
+    void parallel_for(JobSystem &jobs, size_t count, F &&fn) {
+        if (count == 0) return;
+        Plan current = plan(count, jobs.thread_count());
+
+        std::atomic<std::int64_t> busy_ns = 0;
+        jobs.parallel_for_chunks(
+            count, current.chunk_size, current.threads,
+            [&](size_t begin, size_t end) {
+                auto start = std::chrono::steady_clock::now();
+                for (size_t i = begin; i < end; ++i) {
+                    fn(i);
+                }
+                auto elapsed = std::chrono::steady_clock::now() - start;
+                busy_ns.fetch_add(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+                    std::memory_order_relaxed
+                );
+            }
+        );
+        record(count, std::chrono::nanoseconds(busy_ns.load()));
+    }
+
+    /*!
+    Same as `parallel_for`, but the items come in groups that are never split between threads.
+    The items of group `g` are [offsets[g], offsets[g + 1]), the first group can start anywhere.
+    */
+    template <typename F>
+    void parallel_for_groups(JobSystem &jobs, const std::vector<std::uint32_t> &offsets, F &&fn) {
+        if (offsets.size() < 2) return;
+        size_t groups = offsets.size() - 1;
+        size_t count = offsets.back() - offsets.front();
+        if (count == 0) return;
+        Plan current = plan(count, jobs.thread_count());
+
+        // as many groups per chunk as there are items in a planned chunk on average
+        size_t groups_per_chunk = std::max<size_t>(1, current.chunk_size * groups / count);
+
+        std::atomic<std::int64_t> busy_ns = 0;
+        jobs.parallel_for_chunks(
+            groups, groups_per_chunk, current.threads,
+            [&](size_t begin, size_t end) {
+                auto start = std::chrono::steady_clock::now();
+                for (size_t i = offsets[begin]; i < offsets[end]; ++i) {
+                    fn(i);
+                }
+                auto elapsed = std::chrono::steady_clock::now() - start;
+                busy_ns.fetch_add(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+                    std::memory_order_relaxed
+                );
+            }
+        );
+        record(count, std::chrono::nanoseconds(busy_ns.load()));
+    }
+
+private:
+    static constexpr double smoothing = 0.2;
+    static constexpr double initial_cost_ns = 1000.0;
+
+    double cost_per_item_ns = 0.0;  // moving average
+};
+
+#endif  // WORK_TUNER_HPP
@@ -0,0 +1,106 @@
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "../src/body_kernels.hpp"
+#include "../src/visibility.hpp"
+#include "../src/game.cpp"
+
+// about as many bodies as a large level has
+const static size_t body_count = 100 * 100;
+const static size_t step_count = 200;
+const static float delta_time = 1.0f / 60.0f;
+
+static void measure_perception(std::mt19937 &gen) {
+    const size_t side = 100;
+    const size_t enemy_count = 5000;
+    const size_t frame_count = 100;
+
+    std::bernoulli_distribution is_floor(0.8);
+    std::vector<std::uint8_t> passable(side * side);
+    for (auto &it : passable) it = is_floor(gen);
+    SolidTileMap map;
+    map.build(passable, side, side);
+
+    std::uniform_int_distribution<size_t> coord(0, side - 1);
+    std::vector<std::pair<size_t, size_t>> enemies(enemy_count);
+    for (auto &it : enemies) it = {coord(gen), coord(gen)};
+
+    VisibilityCache cache;
+    cache.resize(side * side);
+    size_t visible = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t frame = 0; frame < frame_count; ++frame) {
+        cache.set_target({frame % side, side / 2});  // another tile every frame, nothing is reused
+        for (auto &it : enemies) visible += cache.sees_target(map, it);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double us = (double)std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    std::printf(
+        "perception: %zu enemies in %.1f us per frame, %zu seen\n", enemy_count,
+        us / (double)frame_count, visible / frame_count
+    );
+}
+
+static double measure_ns_per_body(const std::function<void()> &step) {
+    step();  // warm up
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < step_count; ++i) {
+        step();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    return ns / (double)(step_count * body_count);
+}
+
+int main() {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> value(-10.0f, 10.0f);
+
+    std::vector<Enemy> enemies(body_count);
+    for (auto &it : enemies) {
+        it.position() = sf::Vector2f(value(gen), value(gen));
+        it.velocity() = sf::Vector2f(value(gen), value(gen));
+    }
+
+    BodyStore store;
+    store.resize(enemies.size());
+    for (size_t i = 0; i < enemies.size(); ++i) {
+        store.write(i, enemies[i].get_data());
+    }
+    BodyStore initial = store;
+
+    double virtual_ns = measure_ns_per_body([&]() {
+        for (auto &it : enemies) {
+            RigidBody &body = it;
+            body.apply_friction();
+            body.fixed_update(delta_time);
+        }
+    });
+    std::printf("per object, virtual:  %7.3f ns per body\n", virtual_ns);
+
+    auto run_kernel = [&](const char *name, auto kernel) {
+        store = initial;
+        double ns = measure_ns_per_body([&]() {
+            kernel(
+                &store.positions[0].x, &store.velocities[0].x, &store.accelerations[0].x,
+                store.frictions.data(), store.size(), delta_time
+            );
+        });
+        std::printf("%-20s  %7.3f ns per body, x%.2f\n", name, ns, virtual_ns / ns);
+    };
+
+    run_kernel("packed, scalar:", step_bodies_scalar);
+#ifdef BODY_KERNELS_SSE
+    run_kernel("packed, SSE:", step_bodies_sse);
+#endif
+#ifdef BODY_KERNELS_AVX2
+    run_kernel("packed, AVX2:", step_bodies_avx2);
+#endif
+
+    measure_perception(gen);
+
+    return 0;
+}
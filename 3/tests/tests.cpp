@@ -1,5 +1,6 @@
 #include <stdexcept>
 #include <filesystem>
+#include <numeric>
 
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
@@ -10,6 +11,13 @@ namespace fs = std::filesystem;
 
 const static std::string save_path = (fs::path(__FILE__).parent_path() / "test_save.txt").string();
 
+class Pebble : public Item {
+public:
+    using Item::Item;
+
+    std::shared_ptr<Item> deepcopy_item() const override { return deepcopy_shared(*this); }
+};
+
 TEST_CASE("suit") {
     SUBCASE("Testing serialization") {
         SUBCASE("Testing saving") {
@@ -28,6 +36,27 @@ TEST_CASE("suit") {
 
             CHECK(true);
         }
+
+        SUBCASE("Testing background saving") {
+            Game &game = Game::get(true);
+
+            game.setup_default_actors();
+            game.setup_default_items();
+            DungeonLevel level;
+            level.resize_tiles(10, 10);
+            level.regenerate(1);
+            game.dungeon.add_level(level);
+
+            game.save_in_background(save_path);
+            game.saver.wait();
+            CHECK(game.saver.get_status() == BackgroundSaver::Status::Saved);
+            CHECK(!fs::exists(save_path + ".tmp"));
+
+            Game &loaded = Game::get(true);
+            loaded.load(save_path);
+            CHECK(loaded.dungeon.all_levels.size() == 1);
+            CHECK(loaded.dungeon.all_levels[0].enemies.size() == level.enemies.size());
+        }
     }
 
     SUBCASE("Testing loading lev") {
@@ -44,6 +73,119 @@ TEST_CASE("suit") {
         CHECK(game.dungeon.all_levels.size() == 1);
     }
 
+    SUBCASE("Testing seeded levels are the same on any thread") {
+        Game &game = Game::get(true);
+
+        game.setup_default_actors();
+        game.setup_default_items();
+
+        std::vector<DungeonLevel> sequential(4), parallel(4);
+        for (size_t i = 0; i < sequential.size(); ++i) {
+            sequential[i].resize_tiles(15 + i, 20);
+            sequential[i].regenerate(100 + i);
+            parallel[i].resize_tiles(15 + i, 20);
+        }
+
+        JobSystem jobs;
+        jobs.init(4);
+        jobs.parallel_for(parallel.size(), 1, [&](size_t i) { parallel[i].regenerate(100 + i); });
+
+        for (size_t i = 0; i < sequential.size(); ++i) {
+            CHECK(sequential[i].tiles.row_count() == parallel[i].tiles.row_count());
+            bool same_tiles = true;
+            for (size_t x = 0; x < sequential[i].tiles.row_count(); ++x) {
+                for (size_t y = 0; y < sequential[i].tiles.column_count(); ++y) {
+                    same_tiles = same_tiles && sequential[i].tiles[x][y].kind ==
+                                                   parallel[i].tiles[x][y].kind;
+                }
+            }
+            CHECK(same_tiles);
+
+            CHECK(sequential[i].enemies.size() == parallel[i].enemies.size());
+            bool same_enemies = true;
+            for (size_t j = 0; j < sequential[i].enemies.size(); ++j) {
+                const Enemy &a = sequential[i].enemies[j], &b = parallel[i].enemies[j];
+                same_enemies = same_enemies && a.position() == b.position() && a.seed == b.seed;
+            }
+            CHECK(same_enemies);
+            CHECK(sequential[i].initial_player_position == parallel[i].initial_player_position);
+        }
+    }
+
+    SUBCASE("Testing independent games on separate threads") {
+        Game &main_game = Game::get(true);
+
+        // the levels the games should get from their seeds
+        Game reference;
+        std::vector<DungeonLevel> expected(2);
+        {
+            Game::Scope scope(reference);
+            reference.setup_default_actors();
+            reference.setup_default_items();
+            for (size_t i = 0; i < expected.size(); ++i) {
+                expected[i].resize_tiles(15, 15);
+                expected[i].regenerate(7 + i);
+            }
+        }
+
+        std::vector<std::unique_ptr<Game>> games;
+        games.push_back(std::make_unique<Game>());
+        games.push_back(std::make_unique<Game>());
+        std::vector<int> saw_own_game(games.size(), 0);
+        std::vector<int> workers_saw_own_game(games.size(), 0);
+
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < games.size(); ++i) {
+            threads.emplace_back([&, i]() {
+                Game &game = *games[i];
+                Game::Scope scope(game);
+                game.thread_count = 2;
+
+                game.setup_default_actors();
+                game.setup_default_items();
+                DungeonLevel level;
+                level.resize_tiles(15, 15);
+                level.regenerate(7 + i);
+                game.dungeon.add_level(level);
+
+                game.init_headless();
+                game.start_playing();
+                for (size_t step = 0; step < 30; ++step) {
+                    game.step(Game::fixed_delta_time);
+                }
+                saw_own_game[i] = &Game::get() == &game;
+
+                std::atomic<bool> all_own = true;
+                game.jobs.parallel_for(8, 1, [&](size_t) {
+                    if (&Game::get() != &game) all_own = false;
+                });
+                workers_saw_own_game[i] = all_own;
+
+                // only this game may see the change
+                Game::get().dungeon.player.health = 100.0f + i;
+            });
+        }
+        for (auto &it : threads) {
+            it.join();
+        }
+
+        CHECK(&Game::get() == &main_game);
+        CHECK(main_game.dungeon.all_levels.empty());
+        CHECK(main_game.dungeon.player.health != 100.0f);
+        CHECK(main_game.dungeon.player.health != 101.0f);
+        CHECK((saw_own_game[0] && saw_own_game[1]));
+        CHECK((workers_saw_own_game[0] && workers_saw_own_game[1]));
+        for (size_t i = 0; i < games.size(); ++i) {
+            CHECK(games[i]->dungeon.current_level_index == 0);
+            CHECK(games[i]->dungeon.player.health == 100.0f + i);
+            REQUIRE(games[i]->dungeon.all_levels.size() == 1);
+            const DungeonLevel &level = games[i]->dungeon.all_levels[0];
+            CHECK(level.initial_player_position == expected[i].initial_player_position);
+            CHECK(level.tiles.size() == expected[i].tiles.size());
+        }
+        CHECK(expected[0].initial_player_position != expected[1].initial_player_position);
+    }
+
     SUBCASE("Testing init") {
         Game &game = Game::get(true);
 
@@ -162,6 +304,685 @@ TEST_CASE("suit") {
         CHECK(it == mat.end());
     }
 
+    SUBCASE("Testing job system parallel_for") {
+        JobSystem jobs;
+        jobs.init(4);
+        CHECK(jobs.thread_count() == 4);
+
+        std::vector<std::atomic<int>> visits(1000);
+        for (size_t k = 0; k < 10; ++k) {
+            jobs.parallel_for(visits.size(), 7, [&](size_t i) { visits[i]++; });
+        }
+
+        bool all_visited_once_per_call = true;
+        for (auto &it : visits) {
+            all_visited_once_per_call = all_visited_once_per_call && it == 10;
+        }
+        CHECK(all_visited_once_per_call);
+
+        std::vector<size_t> per_thread(jobs.thread_count());
+        jobs.parallel_for(100, 1, [&](size_t) { per_thread[jobs.current_thread_index()]++; });
+        CHECK(std::accumulate(per_thread.begin(), per_thread.end(), size_t(0)) == 100);
+    }
+
+    SUBCASE("Testing work tuner plans") {
+        WorkTuner tuner;
+        CHECK(tuner.plan(2, 8).threads == 1);
+        CHECK(tuner.plan(2, 8).chunk_size == 2);
+
+        tuner.record(100, std::chrono::microseconds(100 * 100));
+        CHECK(tuner.get_cost_per_item_ns() == doctest::Approx(100000.0));
+        CHECK(tuner.plan(1000, 8).threads == 8);
+        CHECK(tuner.plan(1000, 8).chunk_size == 1);
+        CHECK(tuner.plan(1000, 1).threads == 1);
+
+        tuner.limits.max_threads = 3;
+        CHECK(tuner.plan(1000, 8).threads == 3);
+
+        JobSystem jobs;
+        jobs.init(4);
+        std::vector<std::atomic<int>> visits(500);
+        tuner.parallel_for(jobs, visits.size(), [&](size_t i) { visits[i]++; });
+        CHECK(std::all_of(visits.begin(), visits.end(), [](auto &it) { return it == 1; }));
+    }
+
+    SUBCASE("Testing parallel compaction keeps the order") {
+        JobSystem jobs;
+        jobs.init(4);
+
+        std::vector<int> items(1000);
+        std::iota(items.begin(), items.end(), 0);
+        std::vector<std::vector<int>> removed(compaction_chunk_count(items.size(), 64));
+
+        size_t count = parallel_compact(
+            jobs, items, 64, [](int it) { return it % 3 == 0; },
+            [&](int it, size_t chunk) { removed[chunk].push_back(it); }
+        );
+
+        CHECK(count == 334);
+        CHECK(items.size() == 666);
+        CHECK(std::is_sorted(items.begin(), items.end()));
+        CHECK(std::none_of(items.begin(), items.end(), [](int it) { return it % 3 == 0; }));
+        CHECK(removed.front().front() == 0);
+        CHECK(removed.back().back() == 999);
+
+        CHECK(parallel_compact(jobs, items, 64, [](int) { return false; }, [](int, size_t) {}) == 0);
+        CHECK(items.size() == 666);
+
+        // only the survivors after the first removed item move, the plan is reused
+        CompactionPlan plan;
+        size_t first = items[500];
+        parallel_compact(
+            jobs, items, 64, [&](int it) { return it == (int)first; }, [](int, size_t) {}, plan
+        );
+        size_t moves = 0;
+        plan.for_each_move([&](size_t from, size_t to) { moves += from == to + 1; });
+        CHECK(moves == 165);
+        CHECK(items.size() == 665);
+        CHECK(std::is_sorted(items.begin(), items.end()));
+    }
+
+    SUBCASE("Testing behaviour scheduler") {
+        auto step = [](BehaviourContext &context, std::vector<int> &log) -> Behaviour {
+            log.push_back(2);
+            co_await context.wait_for(1.0f);
+            log.push_back(3);
+        };
+        auto script = [&step](BehaviourContext &context, std::vector<int> &log) -> Behaviour {
+            log.push_back(1);
+            co_await step(context, log);
+            co_await context.decide();
+            log.push_back(4);
+        };
+
+        BehaviourScheduler scheduler;
+        scheduler.decision_budget_us = 0.0f;
+        scheduler.max_postponed_ticks = 1;
+        BehaviourContext context;
+        std::vector<int> log;
+
+        Behaviour root = script(context, log);
+        root.start();
+        CHECK((log == std::vector<int>{1, 2}));
+
+        scheduler.begin_frame(0.5f);
+        CHECK(!scheduler.tick(context));
+        scheduler.begin_frame(0.6f);
+        CHECK(scheduler.tick(context));
+        CHECK((log == std::vector<int>{1, 2, 3}));
+
+        scheduler.begin_frame(0.1f);
+        CHECK(!scheduler.tick(context));  // no budget, postponed
+        scheduler.begin_frame(0.1f);
+        CHECK(scheduler.tick(context));
+        CHECK((log == std::vector<int>{1, 2, 3, 4}));
+        CHECK(root.is_done());
+    }
+
+    SUBCASE("Testing patrols wait until the target is reached") {
+        Enemy enemy;
+        EnemyBrain &brain = enemy.brain.create();
+        brain.self = &enemy;
+        brain.home = enemy.position();
+
+        BehaviourScheduler scheduler;
+        scheduler.tick(brain);
+        Behaviour root = patrol(brain, 100.0f);
+        root.start();
+        REQUIRE(brain.wait == BehaviourContext::Wait::Condition);
+
+        // the path can be long, so no amount of time is enough on its own
+        scheduler.begin_frame(50.0f);
+        CHECK(!scheduler.tick(brain));
+        enemy.position() = brain.target;
+        CHECK(scheduler.tick(brain));
+        CHECK(brain.steering == EnemyBrain::Stop);
+
+        // but the patrol still ends in time, after the last stop
+        scheduler.begin_frame(0.5f);
+        CHECK(scheduler.tick(brain));
+        REQUIRE(brain.wait == BehaviourContext::Wait::Condition);
+        scheduler.begin_frame(60.0f);
+        CHECK(scheduler.tick(brain));
+        scheduler.begin_frame(0.5f);
+        CHECK(scheduler.tick(brain));
+        CHECK(root.is_done());
+    }
+
+    SUBCASE("Testing asset loader reports missing images") {
+        JobSystem jobs;
+        jobs.init(2);
+        AssetLoader assets;
+
+        CHECK(AssetLoader::placeholder().getSize() == sf::Vector2u(1, 1));
+
+        bool called = false;
+        assets.request(jobs, "there_is_no_such_image.png", [&](const sf::Image &) {
+            called = true;
+        });
+        CHECK(!assets.is_done());
+        assets.finish(jobs);
+
+        CHECK(assets.is_done());
+        CHECK(!called);
+        CHECK(assets.get_failed().size() == 1);
+    }
+
+    SUBCASE("Testing broadphase matches all-pairs collitions") {
+        Game::get(true);
+
+        DungeonLevel level;
+        level.resize_tiles(20, 20);
+
+        std::mt19937 gen(42);
+        std::uniform_real_distribution<float> coord(-1.0f, 21.0f);
+        std::vector<RigidBody> bodies(300, RigidBody(7.0f, 1.0f));
+        for (auto &it : bodies) {
+            it.position() = sf::Vector2f(coord(gen), coord(gen));
+        }
+        bodies[1].position() = bodies[0].position();
+
+        std::vector<RigidBody> expected = bodies;
+        std::vector<sf::Vector2f> directions(expected.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            for (size_t j = i + 1; j < expected.size(); ++j) {
+                sf::Vector2f correction = actor_actor_correction(
+                    expected[i].get_axes_aligned_bounding_box(),
+                    expected[j].get_axes_aligned_bounding_box()
+                );
+                directions[i] += correction;
+                directions[j] -= correction;
+            }
+        }
+        for (size_t i = 0; i < expected.size(); ++i) {
+            expected[i].position() += directions[i];
+        }
+
+        BodyStore store;
+        store.resize(bodies.size());
+        for (size_t i = 0; i < bodies.size(); ++i) {
+            bodies[i].bind(&store, i);
+        }
+        level.handle_actor_actor_collitions(store, 0, store.size());
+
+        bool same_positions = true;
+        for (size_t i = 0; i < bodies.size(); ++i) {
+            same_positions = same_positions && bodies[i].position() == expected[i].position();
+        }
+        CHECK(same_positions);
+    }
+
+    SUBCASE("Testing spatial queries match the full scan") {
+        Game::get(true);
+
+        DungeonLevel level;
+        level.resize_tiles(20, 20);
+        float factor = level.tile_coords_to_world_coords_factor();
+
+        std::mt19937 gen(3);
+        std::uniform_real_distribution<float> coord(0.0f, 20.0f);
+        for (size_t i = 0; i < 150; ++i) {
+            level.enemies.emplace_back().position() = sf::Vector2f(coord(gen), coord(gen)) * factor;
+            level.laying_items.emplace_back().position() =
+                sf::Vector2f(coord(gen), coord(gen)) * factor;
+        }
+        level.publish_world_state();
+
+        sf::Vector2f center = sf::Vector2f(7.5f, 12.0f) * factor;
+        float radius = 3.0f * factor;
+        SpatialQuery nearby;
+        level.query_radius(center, radius, nearby);
+
+        std::vector<std::uint32_t> enemies, items;
+        for (size_t i = 0; i < level.enemies.size(); ++i) {
+            if (length_squared(level.enemies[i].position() - center) <= radius * radius) {
+                enemies.push_back(i);
+            }
+        }
+        for (size_t i = 0; i < level.laying_items.size(); ++i) {
+            if (length_squared(level.laying_items[i].position() - center) <= radius * radius) {
+                items.push_back(i);
+            }
+        }
+        CHECK(!enemies.empty());
+        CHECK(nearby.enemies == enemies);
+        CHECK(nearby.laying_items == items);
+
+        sf::FloatRect rect(center, sf::Vector2f(2.0f, 4.0f) * factor);
+        level.query_rect(rect, nearby);
+        bool all_inside = true;
+        for (auto i : nearby.enemies) {
+            all_inside = all_inside && rect.contains(level.enemies[i].position());
+        }
+        CHECK(all_inside);
+    }
+
+    SUBCASE("Testing chest index finds the nearest chest") {
+        Game::get(true);
+
+        DungeonLevel level;
+        level.resize_tiles(30, 30);
+        level.set_building(10, 10, std::make_shared<Chest>(1));
+        level.set_building(12, 11, std::make_shared<Chest>(1));
+        level.set_building(20, 5, std::make_shared<Chest>(1));
+        CHECK(level.chest_tiles.size() == 3);
+
+        using Coords = std::pair<size_t, size_t>;
+        auto nearest = level.find_nearest_chest(11, 10, 1.5f);
+        CHECK(nearest.has_value());
+        CHECK(*nearest == Coords(10, 10));
+        CHECK(!level.find_nearest_chest(15, 15, 1.5f).has_value());
+
+        level.set_building(10, 10, nullptr);
+        CHECK(level.chest_tiles.size() == 2);
+        CHECK(*level.find_nearest_chest(11, 10, 1.5f) == Coords(12, 11));
+    }
+
+    SUBCASE("Testing flow field leads around the walls") {
+        Game::get(true);
+
+        DungeonLevel level;
+        level.resize_tiles(7, 7);
+        for (auto &tile : level.tiles) tile.kind = Tile::Flor;
+        for (size_t y = 0; y < 6; ++y) level.tiles[3][y].kind = Tile::Barrier;
+
+        std::vector<std::uint8_t> passable(7 * 7);
+        for (size_t x = 0; x < 7; ++x) {
+            for (size_t y = 0; y < 7; ++y) passable[x * 7 + y] = level.tiles[x][y].is_passable();
+        }
+        level.flow_field.compute(passable, 7, 7, {5, 0});
+
+        CHECK(level.flow_field.direction_at(5, 0) == FlowField::at_goal);
+        CHECK(level.flow_field.direction_at(3, 0) == FlowField::unreachable);
+        CHECK(level.flow_field.step_at(1, 0).y == 1.0f);  // down to the gap in the wall
+
+        // following the field from the far corner gets to the goal through the gap
+        size_t x = 0, y = 0;
+        bool passed_gap = false;
+        const FlowField &field = level.flow_field;
+        for (size_t i = 0; i < 49 && field.direction_at(x, y) != FlowField::at_goal; ++i) {
+            sf::Vector2f step = field.step_at(x, y);
+            x += (int)step.x;
+            y += (int)step.y;
+            REQUIRE(level.tiles[x][y].is_passable());
+            passed_gap = passed_gap || (x == 3 && y == 6);
+        }
+        CHECK((x == 5 && y == 0));
+        CHECK(passed_gap);
+
+        float factor = level.tile_coords_to_world_coords_factor();
+        CHECK(level.flow_direction(sf::Vector2f(4.5f, 0.5f) * factor).x > 0.0f);
+        CHECK(level.flow_direction(sf::Vector2f(5.5f, 0.5f) * factor) == sf::Vector2f(0, 0));
+    }
+
+    SUBCASE("Testing paths go around the walls and are cached") {
+        Game &game = Game::get(true);
+
+        DungeonLevel level;
+        level.resize_tiles(24, 24);
+        for (auto &tile : level.tiles) tile.kind = Tile::Flor;
+        for (size_t y = 0; y < 20; ++y) level.tiles[12][y].kind = Tile::Barrier;
+        level.update_paths();
+        REQUIRE(level.paths.has_graph());
+
+        float factor = level.tile_coords_to_world_coords_factor();
+        sf::Vector2f from = sf::Vector2f(2.5f, 2.5f) * factor;
+        sf::Vector2f to = sf::Vector2f(20.5f, 2.5f) * factor;
+        auto request = level.request_path(from, to);
+        REQUIRE(request);
+        level.update_paths();
+        level.paths.wait(game.jobs);
+        REQUIRE(request->is_done());
+
+        const Path &path = *request->path;
+        REQUIRE(!path.empty());
+        CHECK((path.front() == TileCoords(2, 2)));
+        CHECK((path.back() == TileCoords(20, 2)));
+        bool is_connected = true;
+        bool passed_gap = false;
+        for (size_t i = 1; i < path.size(); ++i) {
+            long dx = (long)path[i].first - (long)path[i - 1].first;
+            long dy = (long)path[i].second - (long)path[i - 1].second;
+            is_connected = is_connected && std::abs(dx) <= 1 && std::abs(dy) <= 1 &&
+                           level.tiles[path[i].first][path[i].second].is_passable();
+            passed_gap = passed_gap || path[i].second >= 20;
+        }
+        CHECK(is_connected);
+        CHECK(passed_gap);
+
+        // the same way is taken from the cache right away
+        auto again = level.request_path(from, to);
+        CHECK(again->is_done());
+        CHECK(again->path == request->path);
+    }
+
+    SUBCASE("Testing enemies do not see the player through the walls") {
+        Game &game = Game::get(true);
+        game.is_headless = true;
+
+        DungeonLevel level;
+        level.resize_tiles(16, 16);
+        for (auto &tile : level.tiles) tile.kind = Tile::Flor;
+        for (size_t y = 0; y < 16; ++y) level.tiles[8][y].kind = Tile::Barrier;
+        level.tiles[8][4].kind = Tile::ClosedDor;
+
+        float factor = level.tile_coords_to_world_coords_factor();
+        game.dungeon.player.position() = sf::Vector2f(4.5f, 4.5f) * factor;
+        // one per region, so the regrouping keeps the order
+        for (sf::Vector2f at : {sf::Vector2f(6.5f, 6.5f), {4.5f, 12.5f}, {10.5f, 4.5f}}) {
+            Enemy &enemy = level.enemies.emplace_back();
+            enemy.position() = at * factor;
+            enemy.brain.create().sight_radius = 10.0f * factor;
+        }
+        auto perceive = [&]() {
+            level.update_lod();
+            level.regroup_enemies();
+            level.publish_world_state();
+            level.update_perception();
+        };
+
+        perceive();
+        CHECK(level.enemies[0].sees_player);
+        CHECK(level.enemies[1].sees_player);
+        CHECK(!level.enemies[2].sees_player);  // behind the closed door
+
+        level.tiles[8][4].kind = Tile::OpenDor;
+        level.solid_tiles.clear();
+        perceive();
+        CHECK(level.enemies[2].sees_player);
+
+        DungeonLevel copy = level;
+        CHECK(copy.player_visibility.get_size() == 0);
+        for (size_t i = 0; i < copy.enemies.size(); ++i) {
+            copy.enemies[i].brain.create().sight_radius = 10.0f * factor;
+        }
+        copy.publish_world_state();
+        copy.update_perception();
+        CHECK(copy.player_visibility.get_size() == copy.tiles.size());
+        CHECK(copy.enemies[2].sees_player);
+    }
+
+    SUBCASE("Testing enemy handles survive regrouping and deletion") {
+        Game &game = Game::get(true);
+
+        DungeonLevel level;
+        level.resize_tiles(32, 8);
+        float factor = level.tile_coords_to_world_coords_factor();
+        std::vector<SlotHandle> handles;
+        for (float x : {28.0f, 20.0f, 12.0f, 4.0f}) {
+            Enemy &enemy = level.enemies.emplace_back();
+            enemy.position() = sf::Vector2f(x, 4.0f) * factor;
+            handles.push_back(level.enemies.handle_of(level.enemies.size() - 1));
+        }
+
+        level.regroup_enemies();
+        REQUIRE(level.enemies.get(handles[0]));
+        CHECK(level.enemies.index_of(handles[0]) == 3);  // the regions are in the reverse order
+        CHECK(level.enemies.get(handles[3])->position() == sf::Vector2f(4.0f, 4.0f) * factor);
+
+        // the same compaction as in `delete_dead_actors`, without the loot
+        level.enemies.get(handles[1])->alive = false;
+        size_t removed = parallel_compact(
+            game.jobs, level.enemies, 2, [](const Enemy &enemy) { return !enemy.alive; },
+            [](Enemy &, size_t) {}
+        );
+        CHECK(removed == 1);
+        CHECK(level.enemies.size() == 3);
+        CHECK(!level.enemies.get(handles[1]));
+        for (size_t i : {0, 2, 3}) {
+            REQUIRE(level.enemies.get(handles[i]));
+            CHECK(level.enemies.get(handles[i])->position().x == (28.0f - 8.0f * i) * factor);
+        }
+
+        // the rows of the store are moved with the enemies, a copy gets rows of its own
+        const BodyStore &bodies = level.enemies.get_store();
+        CHECK(bodies.size() == 3);
+        CHECK(bodies.positions[level.enemies.index_of(handles[3])].x == 4.0f * factor);
+        SlotMap<Enemy, BodyStore> copy = level.enemies;
+        copy[0].position().x += 1.0f;
+        CHECK(copy[0].position() != level.enemies[0].position());
+        CHECK(copy.get_store().positions[0] == copy[0].position());
+
+        // the freed slot is reused, but the old handle still refers to nothing
+        SlotHandle reused = level.enemies.insert(Enemy());
+        CHECK(reused.slot == handles[1].slot);
+        CHECK(!level.enemies.get(handles[1]));
+        CHECK(level.enemies.erase(reused));
+        CHECK(!level.enemies.erase(reused));
+    }
+
+    SUBCASE("Testing laying items merge into stacks") {
+        Game &game = Game::get(true);
+        ItemClass pebble_class("pebble", "", "", 1.0f, Item::Kind::Custom);
+        pebble_class.max_stack_size = 3;
+        size_t pebble = game.add_item_class(pebble_class);
+
+        DungeonLevel level;
+        level.resize_tiles(20, 20);
+        float factor = level.tile_coords_to_world_coords_factor();
+        for (size_t i = 0; i < 5; ++i) {
+            sf::Vector2f position = sf::Vector2f(5.0f + 0.05f * i, 5.0f) * factor;
+            level.laying_items.emplace_back(std::make_shared<Pebble>(pebble), position);
+        }
+        level.laying_items.emplace_back(
+            std::make_shared<Pebble>(pebble), sf::Vector2f(15.0f, 15.0f) * factor
+        );
+
+        for (auto &it : level.laying_items) {
+            it.generated = true;
+        }
+
+        level.update_spatial_index();
+        level.merge_laying_items();
+        level.delete_picked_up_items();
+        REQUIRE(level.laying_items.size() == 3);
+        CHECK(level.laying_items[0].count == 3);
+        CHECK(level.laying_items[1].count == 2);
+        CHECK(level.laying_items[2].count == 1);
+        CHECK(level.dropped_laying_items == 0);
+
+        level.max_laying_items = 2;
+        level.update_spatial_index();
+        level.merge_laying_items();
+        level.delete_picked_up_items();
+        REQUIRE(level.laying_items.size() == 2);
+        CHECK(level.laying_items[0].count == 2);
+        CHECK(level.dropped_laying_items == 1);
+
+        // the items the player threw stay above the cap
+        level.laying_items[1].generated = false;
+        level.max_laying_items = 0;
+        level.update_spatial_index();
+        level.merge_laying_items();
+        level.delete_picked_up_items();
+        REQUIRE(level.laying_items.size() == 1);
+        CHECK(!level.laying_items[0].generated);
+        CHECK(level.laying_items[0].count == 1);
+        CHECK(level.dropped_laying_items == 2);
+
+        LayingItem copy;
+        level.laying_items[0].deepcopy_to(copy);
+        CHECK(copy.count == 1);
+        CHECK(!copy.generated);
+    }
+
+    SUBCASE("Testing body store integrates like the bodies") {
+        std::vector<RigidBody> bodies(10, RigidBody(3.0f, 2.0f));
+        for (size_t i = 0; i < bodies.size(); ++i) {
+            bodies[i].position() = sf::Vector2f(i, 2.0f * i);
+            bodies[i].velocity() = sf::Vector2f(1.0f, -0.5f * i);
+            bodies[i].apply_force(sf::Vector2f(0.25f * i, 1.0f));
+        }
+        std::vector<RigidBody> expected = bodies;
+
+        BodyStore store;
+        store.resize(bodies.size());
+        for (size_t i = 0; i < bodies.size(); ++i) {
+            bodies[i].bind(&store, i);
+        }
+        store.integrate(0, store.size(), 0.1f);
+        for (size_t i = 0; i < bodies.size(); ++i) {
+            expected[i].fixed_update(0.1f);
+        }
+
+        bool same_bodies = true;
+        for (size_t i = 0; i < bodies.size(); ++i) {
+            same_bodies = same_bodies && bodies[i].position() == expected[i].position() &&
+                          bodies[i].velocity() == expected[i].velocity() &&
+                          bodies[i].acceleration() == expected[i].acceleration() &&
+                          store.get_axes_aligned_bounding_box(i, Game::world_size) ==
+                              expected[i].get_axes_aligned_bounding_box();
+        }
+        CHECK(same_bodies);
+
+        // the data goes back to the bodies with them
+        bodies[0].unbind();
+        store.positions[0] = sf::Vector2f(-1.0f, -1.0f);
+        CHECK(bodies[0].position() == expected[0].position());
+    }
+
+    SUBCASE("Testing body kernels match the bodies") {
+        std::vector<RigidBody> bodies(11, RigidBody(2.0f, 3.0f));
+        for (size_t i = 0; i < bodies.size(); ++i) {
+            bodies[i].position() = sf::Vector2f(i, -1.0f * i);
+            bodies[i].velocity() = sf::Vector2f(2.0f - i, 0.5f * i);
+            bodies[i].friction_coefficient() = 0.5f + 0.25f * i;
+        }
+
+        BodyStore store;
+        store.resize(bodies.size());
+        for (size_t i = 0; i < bodies.size(); ++i) {
+            store.write(i, bodies[i].get_data());
+        }
+        BodyStore scalar = store;
+        step_bodies_scalar(
+            &scalar.positions[0].x, &scalar.velocities[0].x, &scalar.accelerations[0].x,
+            scalar.frictions.data(), scalar.size(), 0.1f
+        );
+        store.step(0, store.size(), 0.1f);
+
+        bool same_bodies = true;
+        for (size_t i = 0; i < bodies.size(); ++i) {
+            bodies[i].apply_friction();
+            bodies[i].fixed_update(0.1f);
+            same_bodies = same_bodies &&
+                          length(bodies[i].position() - store.positions[i]) < 1e-5f &&
+                          length(bodies[i].velocity() - store.velocities[i]) < 1e-5f &&
+                          length(scalar.positions[i] - store.positions[i]) < 1e-6f;
+        }
+        CHECK(same_bodies);
+    }
+
+    SUBCASE("Testing regrouping enemies by regions") {
+        Game::get(true);
+
+        DungeonLevel level;
+        level.resize_tiles(20, 20);
+        float factor = level.tile_coords_to_world_coords_factor();
+
+        std::mt19937 gen(7);
+        std::uniform_real_distribution<float> coord(-1.0f, 21.0f);
+        std::vector<sf::Vector2f> positions;
+        for (size_t i = 0; i < 200; ++i) {
+            Enemy &enemy = level.enemies.emplace_back();
+            enemy.position() = sf::Vector2f(coord(gen), coord(gen)) * factor;
+            positions.push_back(enemy.position());
+        }
+        level.regroup_enemies();
+
+        CHECK(level.region_offsets.size() == 3 * 3 + 1);
+        CHECK(level.region_offsets.back() == positions.size());
+
+        // every region holds its own enemies, in the order they had before
+        std::vector<sf::Vector2f> expected;
+        for (size_t r = 0; r + 1 < level.region_offsets.size(); ++r) {
+            for (auto &it : positions) {
+                if (level.region_of(it) == r) expected.push_back(it);
+            }
+        }
+        bool same_positions = level.enemies.size() == expected.size();
+        for (size_t i = 0; same_positions && i < expected.size(); ++i) {
+            same_positions = level.enemies[i].position() == expected[i];
+        }
+        CHECK(same_positions);
+    }
+
+    SUBCASE("Testing background levels tick at a lower rate") {
+        Game::get(true);
+
+        DungeonLevel level;
+        level.resize_tiles(20, 20);
+        Enemy &enemy = level.enemies.emplace_back(0, 1.0f, Characteristics{10, 0, 5}, 1);
+        enemy.brain.create().home = level.center();
+        enemy.position() = level.center() + sf::Vector2f(3, 0);
+
+        CHECK(!level.background_update(0.1f, 0.25f, 1000.0f));
+        CHECK(enemy.position() == level.center() + sf::Vector2f(3, 0));
+
+        CHECK(level.background_update(0.2f, 0.25f, 1000.0f));
+        CHECK(length(enemy.position() - level.center()) < 3.0f);
+    }
+
+    SUBCASE("Testing far enemies are updated less often") {
+        Game &game = Game::get(true);
+        game.is_headless = true;  // no camera, only the distances count
+
+        DungeonLevel level;
+        level.resize_tiles(64, 64);
+        float factor = level.tile_coords_to_world_coords_factor();
+        game.dungeon.player.position() = sf::Vector2f(4, 4) * factor;
+        for (float x : {4.0f, 28.0f, 36.0f, 60.0f}) {
+            Enemy &enemy = level.enemies.emplace_back();
+            enemy.position() = sf::Vector2f(x, 4.0f) * factor;
+            enemy.seed = 2;  // the phase of the skipped frames
+            enemy.alive = false;  // nothing to think about, only the timing is checked
+        }
+        level.update_lod();
+        level.regroup_enemies();
+
+        // the dormant one is put aside in front of the rest
+        CHECK(level.dormant_count == 1);
+        CHECK(level.enemies[0].position().x == 60.0f * factor);
+        CHECK((level.active_lods == std::vector<std::uint8_t>{0, 1, 2}));
+
+        for (size_t i = 0; i < 4; ++i) level.update_enemies(0.1f);
+        CHECK(level.enemies[1].lod_delta_time == 0.0f);
+        CHECK(level.enemies[3].lod_delta_time == 0.2f);  // updated on the second frame only
+        CHECK(level.enemies[0].lod_delta_time == 0.0f);  // dormant, the time does not pass
+
+        level.publish_world_state();
+        CHECK(level.world_state.read().first_enemy == 1);
+        CHECK(level.world_state.read().enemies.size() == 3);
+        // the rows of the bodies are moved with the enemies
+        const BodyStore &bodies = level.enemies.get_store();
+        CHECK(bodies.size() == 4);
+        CHECK(bodies.positions[0] == level.enemies[0].position());
+        CHECK(bodies.positions[3] == level.enemies[3].position());
+
+        // the player walks to the other end, the first one falls asleep and the last one wakes up
+        game.dungeon.player.position() = sf::Vector2f(60, 4) * factor;
+        level.update_lod();
+        level.regroup_enemies();
+        CHECK(level.dormant_count == 1);
+        CHECK(level.enemies[0].position().x == 4.0f * factor);
+        CHECK(level.enemies[3].position().x == 60.0f * factor);
+        CHECK((level.active_lods == std::vector<std::uint8_t>{2, 1, 0}));
+
+        // and the phase stays with the enemy, wherever it is
+        for (size_t i = 0; i < 4; ++i) level.update_enemies(0.1f);
+        CHECK(level.enemies[1].lod_delta_time == 0.2f);
+
+        // only the awake ones are regrouped while nobody falls asleep
+        level.enemies[1].position().x = 44.0f * factor;
+        level.update_lod();
+        level.regroup_enemies();
+        CHECK(level.dormant_count == 1);
+        CHECK(level.enemies[0].position().x == 4.0f * factor);
+        CHECK(level.enemies[1].position().x == 36.0f * factor);
+        CHECK(level.enemies[2].position().x == 44.0f * factor);
+        CHECK((level.region_offsets.front() == 1 && level.region_offsets.back() == 4));
+    }
+
     SUBCASE("Testing item ptr via hammer") {
         Game &game = Game::get(true);
 